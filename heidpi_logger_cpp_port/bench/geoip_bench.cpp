@@ -0,0 +1,102 @@
+// Micro-benchmark for GeoIP enrichment: ns/lookup of the MMDB tree walk
+// (with and without the per-thread caches) against the flat range table,
+// on the same stream of random IPv4 addresses. Also checks that all
+// variants produce the same output.
+//
+//   geoip_bench <database.mmdb> [lookups] [distinct addresses]
+#include "Config.hpp"
+#include "GeoIP.hpp"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> addresses(std::size_t count) {
+    std::vector<std::string> out;
+    out.reserve(count);
+    std::uint64_t state = 0x9e3779b97f4a7c15ULL;
+    char buf[INET_ADDRSTRLEN];
+    for (std::size_t i = 0; i < count; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        auto addr = htonl(static_cast<std::uint32_t>(state));
+        inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+        out.emplace_back(buf);
+    }
+    return out;
+}
+
+static double nsPerLookup(const GeoIP &geo, const std::vector<std::string> &ips, std::size_t lookups) {
+    EventString line;
+    std::size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < lookups; ++i) {
+        line.clear();
+        geo.enrichRaw(ips[i % ips.size()], std::string(), line);
+        bytes += line.size();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (bytes == 0) std::cerr << "no address was found in the database\n";
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(lookups);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: geoip_bench <database.mmdb> [lookups] [distinct addresses]\n";
+        return 2;
+    }
+    std::size_t lookups = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+    std::size_t distinct = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1 << 20;
+    auto ips = addresses(distinct ? distinct : 1);
+
+    EventConfig base;
+    base.geoip_enabled = true;
+    base.geoip_path = argv[1];
+    base.geoip_keys = {"country.names.en", "location"};
+    base.geoip_bypass_reserved = false;
+
+    EventConfig cached = base;
+    cached.geoip_cache_size = 4096;
+    cached.geoip_record_cache_size = 16384;
+    EventConfig flat = base;
+    flat.geoip_flat_table = true;
+
+    std::vector<std::pair<const char *, EventConfig>> variants{
+        {"tree", base}, {"tree+caches", cached}, {"flat", flat}};
+    std::vector<std::unique_ptr<GeoIP>> geos;
+    for (const auto &variant : variants) {
+        geos.push_back(std::make_unique<GeoIP>(variant.second));
+        if (!geos.back()->ok()) return 1;
+    }
+
+    // every variant must give the same fragments
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < std::min<std::size_t>(ips.size(), 100000); ++i) {
+        EventString expected, got;
+        geos[0]->enrichRaw(ips[i], std::string(), expected);
+        for (std::size_t v = 1; v < geos.size(); ++v) {
+            got.clear();
+            geos[v]->enrichRaw(ips[i], std::string(), got);
+            if (got != expected && mismatches++ < 5) {
+                std::cerr << "mismatch for " << ips[i] << " (" << variants[v].first << "): "
+                          << got << " vs " << expected << "\n";
+            }
+        }
+    }
+    if (mismatches) std::cerr << mismatches << " mismatches\n";
+
+    std::cout << "ns/lookup, " << lookups << " lookups over " << ips.size() << " addresses\n";
+    for (std::size_t v = 0; v < geos.size(); ++v) {
+        nsPerLookup(*geos[v], ips, lookups / 10); // warm-up
+        std::cout << std::left << std::setw(14) << variants[v].first << std::fixed
+                  << std::setprecision(1) << nsPerLookup(*geos[v], ips, lookups) << "\n";
+    }
+    std::cout << geos.back()->stats() << "\n";
+    return mismatches ? 1 : 0;
+}
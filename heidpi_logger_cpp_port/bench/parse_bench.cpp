@@ -0,0 +1,196 @@
+// Micro-benchmark for event parsing: ns/event and heap allocations per
+// event of each parse engine on the event shapes emitted by the benchmark
+// generator. "reader" is the socket reader's extract only; "event" is the
+// whole path of a logged event as in EventProcessor: extract, the worker's
+// full parse, timestamp, GeoIP enrichment (if a database is given, with
+// the config.yml cache and flat table settings) and serialization. Events
+// are built in the arena as in the logger and dropped after each iteration.
+//
+//   parse_bench [iterations] [database.mmdb]
+//
+// Measured with a synthetic database, heap allocations per event: nlohmann
+// 8-9 in both columns, the scratch buffers of nlohmann's parser (lexer and
+// parse stacks, not covered by the arena); simdjson 0 in both, the worker's
+// full parse walks the document with a per-thread simdjson parser and builds
+// it in the arena. GeoIP enrichment and serialization add none.
+#include "Config.hpp"
+#include "EventType.hpp"
+#include "FieldExtractor.hpp"
+#include "GeoIP.hpp"
+#include "Projection.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// every heap allocation of the process goes through here; kept out of line,
+// or GCC sees malloc() paired with operator delete and warns
+static std::atomic<std::uint64_t> allocations{0};
+
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+using json = nlohmann::json;
+
+// Same shapes as benchmark/src/generator.cpp
+static std::vector<std::pair<std::string, json>> shapes() {
+    const std::uint64_t ts = 1700000000000000ULL;
+    return {
+        {"flow", {
+            {"alias", "benchmark"}, {"source", "benchmark"}, {"thread_id", 0},
+            {"packet_id", 4711}, {"flow_event_id", 12}, {"flow_event_name", "update"},
+            {"flow_id", 815}, {"flow_state", "info"},
+            {"flow_src_packets_processed", 1}, {"flow_dst_packets_processed", 1},
+            {"flow_first_seen", ts}, {"flow_src_last_pkt_time", ts}, {"flow_dst_last_pkt_time", ts},
+            {"flow_idle_time", 10},
+            {"flow_src_min_l4_payload_len", 0}, {"flow_dst_min_l4_payload_len", 0},
+            {"flow_src_max_l4_payload_len", 0}, {"flow_dst_max_l4_payload_len", 0},
+            {"flow_src_tot_l4_payload_len", 0}, {"flow_dst_tot_l4_payload_len", 0},
+            {"flow_datalink", 1}, {"flow_max_packets", 10},
+            {"l3_proto", "ip4"}, {"l4_proto", "tcp"}, {"midstream", 0},
+            {"thread_ts_usec", ts}, {"src_ip", "8.8.8.8"}, {"dst_ip", "4.4.4.4"}}},
+        {"daemon", {
+            {"alias", "benchmark"}, {"source", "benchmark"}, {"thread_id", 0},
+            {"packet_id", 4711}, {"daemon_event_id", 1}, {"daemon_event_name", "init"},
+            {"max-flows-per-thread", 2048}, {"max-idle-flows-per-thread", 64},
+            {"reader-thread-count", 10}, {"flow-scan-interval", 10000000},
+            {"generic-max-idle-time", 600000000}, {"icmp-max-idle-time", 120000000},
+            {"udp-max-idle-time", 180000000}, {"tcp-max-idle-time", 7560000000ULL},
+            {"max-packets-per-flow-to-send", 15}, {"max-packets-per-flow-to-process", 32},
+            {"max-packets-per-flow-to-analyse", 32}, {"global_ts_usec", ts}}},
+        {"error", {
+            {"alias", "benchmark"}, {"source", "benchmark"}, {"packet_id", 4711},
+            {"error_event_id", 3}, {"error_event_name", "Unknown packet type"},
+            {"datalink", 1}, {"threshold_n", 1}, {"threshold_n_max", 1},
+            {"threshold_time", 1}, {"threshold_ts_usec", ts}, {"global_ts_usec", ts}}},
+        {"packet", {
+            {"alias", "benchmark"}, {"source", "benchmark"}, {"thread_id", 0},
+            {"packet_id", 4711}, {"packet_event_id", 7}, {"packet_event_name", "packet-flow"},
+            {"flow_id", 815}, {"flow_packet_id", 2},
+            {"flow_src_last_pkt_time", ts}, {"flow_dst_last_pkt_time", ts}, {"flow_idle_time", 10},
+            {"pkt_caplen", 64}, {"pkt_type", 0}, {"pkt_l3_offset", 14}, {"pkt_l4_offset", 34},
+            {"pkt_len", 64}, {"pkt_l4_len", 20}, {"thread_ts_usec", ts}, {"pkt", ""}}},
+    };
+}
+
+// What the reader in main.cpp extracts without a --filter.
+static FieldSet readerFields() {
+    FieldSet fields;
+    fields.add({"flow_id"});
+    fields.add({"packet_id"});
+    for (std::size_t t = 0; t < kEventTypeCount; ++t) {
+        fields.add({eventNameKey(static_cast<EventType>(t))});
+    }
+    return fields;
+}
+
+struct Cost {
+    double ns;
+    double allocs;
+};
+
+// Where `full` events go after the reader, as in EventProcessor::write().
+struct Worker {
+    const GeoIP *geo{nullptr};
+    Projection projection;
+    std::string line;
+
+    void process(Event &event) {
+        event.dom();
+        EventJson &out = event.fields;
+        out["timestamp"] = "2026-01-01T00:00:00";
+        if (geo) geo->enrich(out.value("src_ip", ""), out.value("dst_ip", ""), out);
+        line.clear();
+        projection.serialize(out, line);
+    }
+};
+
+static Cost perEvent(FieldExtractor &extractor, const std::string &frame, std::size_t iterations,
+                     Worker *worker) {
+    std::size_t ok = 0, bytes = 0;
+    auto allocsBefore = allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        Event event;
+        EventArena::Scope scope(event.arena);
+        event.raw.reserve(frame.size() + kParsePadding);
+        event.raw.assign(frame);
+        ok += extractor.extract(event);
+        if (worker) {
+            worker->process(event);
+            bytes += worker->line.size();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto allocs = allocations.load(std::memory_order_relaxed) - allocsBefore;
+    if (ok != iterations) std::cerr << "parse failures: " << iterations - ok << "\n";
+    if (worker && bytes == 0) std::cerr << "nothing serialized\n";
+    auto n = static_cast<double>(iterations);
+    return {std::chrono::duration<double, std::nano>(elapsed).count() / n, static_cast<double>(allocs) / n};
+}
+
+int main(int argc, char **argv) {
+    std::size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    FieldSet fields = readerFields();
+
+    Worker worker;
+    std::unique_ptr<GeoIP> geo;
+    if (argc > 2) {
+        EventConfig cfg;
+        cfg.geoip_enabled = true;
+        cfg.geoip_path = argv[2];
+        cfg.geoip_keys = {"country.names.en", "location"};
+        cfg.geoip_cache_size = 4096;
+        cfg.geoip_record_cache_size = 16384;
+        cfg.geoip_flat_table = true;
+        geo = std::make_unique<GeoIP>(cfg);
+        if (!geo->ok()) return 1;
+        worker.geo = geo.get();
+    } else {
+        std::cout << "(no database, events are not enriched)\n";
+    }
+
+    std::vector<std::pair<const char *, ParseEngine>> engines{{"nlohmann", ParseEngine::Nlohmann}};
+#ifdef HEIDPI_HAVE_SIMDJSON
+    engines.emplace_back("simdjson", ParseEngine::Simdjson);
+#else
+    std::cout << "(built without simdjson)\n";
+#endif
+
+    std::cout << "ns/event and heap allocations/event, " << iterations << " iterations\n"
+              << std::left << std::setw(8) << "" << std::setw(8) << "";
+    for (const auto &engine : engines) std::cout << std::setw(44) << engine.first;
+    std::cout << "\n" << std::setw(8) << "event" << std::setw(8) << "bytes";
+    for (std::size_t e = 0; e < engines.size(); ++e) {
+        std::cout << std::setw(14) << "reader" << std::setw(8) << "allocs" << std::setw(14) << "event"
+                  << std::setw(8) << "allocs";
+    }
+    std::cout << "\n";
+    for (const auto &[name, event] : shapes()) {
+        std::string frame = event.dump();
+        std::cout << std::setw(8) << name << std::setw(8) << frame.size();
+        for (const auto &engine : engines) {
+            auto extractor = FieldExtractor::create(engine.second, fields);
+            for (Worker *w : {static_cast<Worker *>(nullptr), &worker}) {
+                perEvent(*extractor, frame, iterations / 10, w); // warm-up
+                Cost cost = perEvent(*extractor, frame, iterations, w);
+                std::cout << std::setw(14) << std::fixed << std::setprecision(1) << cost.ns
+                          << std::setw(8) << std::setprecision(2) << cost.allocs;
+            }
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Micro-benchmark for the schema-generated event records: ns/event of
+// reading the fields the flow tracking uses by member lookup against
+// decoding the typed record in one pass, on the event shapes emitted by the
+// benchmark generator. Also checks that serializing a record gives the
+// bytes of the document it was parsed from, extra members included.
+//
+//   schema_bench [iterations]
+#include "EventSchema.hpp"
+#include "JsonWriter.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+// Same shapes as benchmark/src/generator.cpp, plus a member that is not in
+// the schema and one whose value does not fit its field.
+EventJson flowShape() {
+    return EventJson::parse(R"({"alias":"benchmark","source":"benchmark","thread_id":0,"packet_id":4711,
+        "flow_event_id":4,"flow_event_name":"update","flow_id":815,"flow_state":"info",
+        "flow_src_packets_processed":1,"flow_dst_packets_processed":1,"flow_first_seen":1700000000000000,
+        "flow_src_last_pkt_time":1700000000000000,"flow_dst_last_pkt_time":1700000000000000,"flow_idle_time":10,
+        "flow_src_min_l4_payload_len":0,"flow_dst_min_l4_payload_len":0,"flow_src_max_l4_payload_len":0,
+        "flow_dst_max_l4_payload_len":0,"flow_src_tot_l4_payload_len":0,"flow_dst_tot_l4_payload_len":0,
+        "flow_datalink":1,"flow_max_packets":10,"l3_proto":"ip4","l4_proto":6,"midstream":0,
+        "thread_ts_usec":1700000000000000,"src_ip":"8.8.8.8","dst_ip":"4.4.4.4",
+        "ndpi":{"proto":"TLS","proto_id":"91","breed":"Safe","encrypted":1},"timestamp":"x"})");
+}
+
+EventJson packetShape() {
+    return EventJson::parse(R"({"alias":"benchmark","source":"benchmark","thread_id":0,"packet_id":4711,
+        "packet_event_id":2,"packet_event_name":"packet-flow","flow_id":815,"flow_packet_id":2,
+        "flow_src_last_pkt_time":1700000000000000,"flow_dst_last_pkt_time":1700000000000000,
+        "flow_idle_time":10,"pkt_caplen":64,"pkt_type":0,"pkt_l3_offset":14,"pkt_l4_offset":34,"pkt_len":64,
+        "pkt_l4_len":20,"thread_ts_usec":1700000000000000,"pkt":"","pkt_datalink":1})");
+}
+
+EventJson daemonShape() {
+    return EventJson::parse(R"({"alias":"benchmark","source":"benchmark","thread_id":0,"packet_id":4711,
+        "daemon_event_id":1,"daemon_event_name":"init","max-flows-per-thread":2048,
+        "max-idle-flows-per-thread":64,"reader-thread-count":10,"flow-scan-interval":10000000,
+        "generic-max-idle-time":600000000,"icmp-max-idle-time":120000000,"udp-max-idle-time":180000000,
+        "tcp-max-idle-time":7560000000,"max-packets-per-flow-to-send":15,"max-packets-per-flow-to-process":32,
+        "max-packets-per-flow-to-analyse":32,"global_ts_usec":1700000000000000,"version":"1.7"})");
+}
+
+EventJson errorShape() {
+    return EventJson::parse(R"({"alias":"benchmark","source":"benchmark","packet_id":4711,"error_event_id":4,
+        "error_event_name":"Unknown packet type","datalink":1,"threshold_n":1,"threshold_n_max":1,
+        "threshold_time":1,"threshold_ts_usec":1700000000000000,"global_ts_usec":1700000000000000,
+        "size":-1.5})");
+}
+
+// The members FlowManager::update() reads, looked up one by one.
+std::uint64_t lookups(const EventJson &event) {
+    std::uint64_t sum = 0;
+    for (const char *key : {"alias", "source", "thread_id", "flow_id", "flow_src_last_pkt_time",
+                            "flow_dst_last_pkt_time", "flow_idle_time", "thread_ts_usec", "flow_event_name",
+                            "daemon_event_name"}) {
+        auto it = event.find(key);
+        if (it == event.end()) continue;
+        if (it->is_number_unsigned()) sum += it->get<std::uint64_t>();
+        else if (it->is_string()) sum += it->get_ref<const EventString &>().size();
+    }
+    return sum;
+}
+
+template <typename Record>
+std::uint64_t decode(const EventJson &event, Record &record) {
+    record.parse(event, false);
+    return record.present;
+}
+
+template <typename Fn>
+double nsPerEvent(Fn &&fn, std::size_t iterations) {
+    volatile std::uint64_t sink = 0; // keeps the loop
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) sink += fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+template <typename Record>
+void run(const char *name, const EventJson &event, std::size_t iterations) {
+    std::string expected, got;
+    JsonWriter(expected).value(event);
+    Record record;
+    record.parse(event);
+    JsonWriter writer(got);
+    record.serialize(writer);
+    std::size_t overflow = record.overflow.size();
+
+    double viaLookup = nsPerEvent([&] { return lookups(event); }, iterations);
+    double viaRecord = nsPerEvent([&] { return decode(event, record); }, iterations);
+    std::cout << std::setw(8) << name << std::setw(10) << overflow << std::setw(12) << std::fixed
+              << std::setprecision(1) << viaLookup << std::setw(12) << viaRecord << std::setw(12)
+              << (got == expected ? "same" : "DIFFERENT") << "\n";
+    if (got != expected) std::cerr << "expected " << expected << "\n     got " << got << "\n";
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    std::size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    std::cout << "ns/event, " << iterations << " iterations\n"
+              << std::left << std::setw(8) << "event" << std::setw(10) << "overflow" << std::setw(12) << "lookup"
+              << std::setw(12) << "record" << std::setw(12) << "roundtrip" << "\n";
+    run<FlowEventRecord>("flow", flowShape(), iterations);
+    run<PacketEventRecord>("packet", packetShape(), iterations);
+    run<DaemonEventRecord>("daemon", daemonShape(), iterations);
+    run<ErrorEventRecord>("error", errorShape(), iterations);
+    return 0;
+}
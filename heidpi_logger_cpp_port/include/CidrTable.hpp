@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "GeoIPCache.hpp"
+
+/**
+ * @brief Set of IPv4/IPv6 prefixes with a static GeoIP result each, checked
+ *        before the MMDB lookup. Prefixes are flattened into a sorted table
+ *        of disjoint ranges (IPv4 as v4-mapped IPv6), so a lookup is one
+ *        binary search. The most specific prefix wins; for identical
+ *        prefixes the one added last.
+ */
+class CidrTable {
+public:
+    // RFC 1918, loopback, link-local, CGNAT, documentation, multicast and
+    // other special-purpose ranges that never have GeoIP data.
+    void addReserved();
+    // `label` is the result for matching addresses; null means no
+    // enrichment. Throws std::runtime_error on a malformed prefix.
+    void add(const std::string &cidr, const nlohmann::json &label);
+    // Call once after all add()s.
+    void build();
+
+    bool empty() const { return ranges.empty(); }
+    // Result for `key`, nullptr if no prefix matches.
+    const GeoIPCache::Result *find(const GeoIPCache::Key &key) const;
+
+private:
+    using Key = GeoIPCache::Key;
+    struct Range {
+        Key lo;
+        Key hi;
+        std::uint32_t label; // index into `labels`
+    };
+
+    std::vector<Range> prefixes; // as added, possibly nested
+    std::vector<Range> ranges;   // disjoint, sorted
+    std::vector<GeoIPCache::Result> labels;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <nlohmann/json.hpp>
@@ -12,30 +13,120 @@ struct LoggingConfig {
     std::string format{"%Y-%m-%dT%H:%M:%S"};
     std::string datefmt{"%Y-%m-%dT%H:%M:%S"};
     std::string filename{}; // optional log file
+    int stats_interval{10}; // seconds between pipeline statistics, 0 = off
 };
 
+/**
+ * @brief When buffered output of an event type is written to its file.
+ *        Bytes: once `bytes` are pending; Interval: once the oldest pending
+ *        line is `interval_ms` old; Event: after every line.
+ *        Durability: None leaves syncing to the kernel, Interval calls
+ *        fdatasync every `sync_interval_ms`, Batch after every write.
+ */
+struct FlushPolicy {
+    enum class Mode { Bytes, Interval, Event };
+    enum class Durability { None, Interval, Batch };
+    Mode mode{Mode::Interval};
+    std::size_t bytes{64 * 1024};
+    int interval_ms{100};
+    Durability durability{Durability::None};
+    int sync_interval_ms{1000};
+};
+
+/**
+ * @brief Bound and overload behaviour of the queue between socket reader and
+ *        dispatcher. Bytes are counted as the memory a queued event holds:
+ *        its frame plus what the reader parsed from it.
+ */
+struct QueueConfig {
+    enum class Policy { Block, DropOldest, DropPriority, Sample };
+    std::size_t capacity_events{65536};
+    std::size_t capacity_bytes{64 * 1024 * 1024};
+    Policy policy{Policy::Block};
+    double sample_rate{0.1}; // share of events kept by Policy::Sample under load
+};
+
+/**
+ * @brief Flow tracking on the dispatcher thread (FlowManager). It sees the
+ *        events of the enabled types only, so daemon init/shutdown cleanups
+ *        need daemon events enabled.
+ */
+struct FlowTrackingConfig {
+    bool enabled{false};
+    std::size_t expected_flows{65536}; // initial table size, grows as needed
+};
+
+/**
+ * @brief Sampled validation of received events against the nDPId schemas
+ *        (SchemaValidator), off the logging path.
+ */
+struct SchemaValidationConfig {
+    bool enabled{false};
+    double sample_rate{0.01};                // share of the events checked
+    std::size_t queue_size{1024};            // sampled events waiting; more are skipped
+    std::string schema_dir{"heidpi/schema"}; // *_event_schema.json
+};
+
+// Engine the reader uses to pull fields out of received frames.
+enum class ParseEngine { Nlohmann, Simdjson };
+
 struct EventConfig {
-    std::vector<std::string> ignore_fields;
+    std::vector<std::string> ignore_fields; // top-level or dotted paths
     std::vector<std::string> ignore_risks;
+    std::vector<std::string> keep_fields;   // if set, only these paths are written
     std::vector<std::string> event_names; // empty -> allow all event names
     std::string filename{"event"};
     int threads{1};
+    FlushPolicy flush;
+    // Write the received bytes with timestamp/GeoIP appended instead of
+    // re-serializing the event. Only used if nothing is ignored.
+    bool raw_output{false};
+    // Fold the events of each flow into one record per flow (flow events only)
+    bool aggregate{false};
+    std::size_t aggregate_max_mb{256};  // flow state over all threads, then flushed early
+    bool aggregate_keep_events{false}; // also write the single events
+    // Tumbling-window rollups per group of field values (see Rollup)
+    bool rollup{false};
+    int rollup_window_seconds{60};
+    std::vector<std::string> rollup_group_by; // field paths, e.g. ndpi.proto
+    std::size_t rollup_max_groups{4096};      // per worker thread and window
+    bool rollup_csv{false};                   // CSV instead of JSON lines
+    std::string rollup_filename;              // default: <filename>_rollup
+    std::size_t rollup_top_k{0};              // heaviest src_ip/dst_ip per window, 0 = off
+    bool rollup_distinct_ips{false};          // distinct src_ip/dst_ip per window
+    std::size_t rollup_sketch_width{2048};    // Count-Min counters per row
+    bool log_events{true}; // false: only aggregates/rollups are written
     // GeoIP configuration (flow events only)
     bool geoip_enabled{false};
     std::string geoip_path{};
     std::vector<std::string> geoip_keys;
+    bool geoip_reload{true};                // reopen geoip_path when the file is replaced
+    std::size_t geoip_cache_size{0};        // results cached per worker thread by address, 0 = off
+    std::size_t geoip_record_cache_size{0}; // ... by MMDB data record, 0 = off
+    bool geoip_flat_table{false};             // export the database into a GeoIPTable
+    std::size_t geoip_flat_table_max_mb{512}; // ... unless it would need more
+    bool geoip_bypass_reserved{true}; // no lookups for private/reserved networks
+    std::vector<std::pair<std::string, nlohmann::json>> geoip_bypass; // CIDR -> fixed result, null = none
 };
 
 class Config {
 public:
     explicit Config(const std::string &path);
     const LoggingConfig &logging() const { return logging_cfg; }
+    const QueueConfig &queue() const { return queue_cfg; }
+    ParseEngine parser() const { return parse_engine; }
+    const FlowTrackingConfig &flowTracking() const { return flow_tracking_cfg; }
+    const SchemaValidationConfig &schemaValidation() const { return schema_validation_cfg; }
     const EventConfig &flowEvent() const { return flow_cfg; }
     const EventConfig &packetEvent() const { return packet_cfg; }
     const EventConfig &daemonEvent() const { return daemon_cfg; }
     const EventConfig &errorEvent() const { return error_cfg; }
 private:
     LoggingConfig logging_cfg;
+    QueueConfig queue_cfg;
+    ParseEngine parse_engine{ParseEngine::Nlohmann};
+    FlowTrackingConfig flow_tracking_cfg;
+    SchemaValidationConfig schema_validation_cfg;
     EventConfig flow_cfg;
     EventConfig packet_cfg;
     EventConfig daemon_cfg;
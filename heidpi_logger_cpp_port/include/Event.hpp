@@ -0,0 +1,50 @@
+#pragma once
+#include <utility>
+#include "EventArena.hpp"
+
+/**
+ * @brief One received event on its way from the socket to the output file.
+ *        `raw` keeps the frame as received. `fields` holds what the reader
+ *        stage extracted from it: either only the fields it asked for or,
+ *        if `complete`, the whole document. Both live in the EventArena
+ *        blocks `arena` holds, so events are move-only and their memory is
+ *        recycled once they are written.
+ */
+struct Event {
+    EventArena::Hold arena; // first, so it is released after raw and fields
+    EventString raw;
+    EventJson fields;
+    bool complete{false};
+    // Set by an extractor that builds the whole document itself (in the
+    // arena, without nlohmann's parser); dom() uses EventJson::parse otherwise.
+    void (*parseDom)(Event &){nullptr};
+
+    Event() = default;
+    Event(Event &&) = default;
+    Event &operator=(Event &&other) noexcept {
+        // the old value is freed while its blocks are still held
+        raw = std::move(other.raw);
+        discardJson(fields);
+        fields = std::move(other.fields);
+        complete = other.complete;
+        parseDom = other.parseDom;
+        arena = std::move(other.arena);
+        return *this;
+    }
+    ~Event() { discardJson(fields); }
+
+    // Whole document; parsed from `raw` on first use.
+    const EventJson &dom() {
+        if (!complete) {
+            if (parseDom) {
+                parseDom(*this);
+            } else {
+                EventJson parsed = EventJson::parse(raw);
+                discardJson(fields);
+                fields = std::move(parsed);
+            }
+            complete = true;
+        }
+        return fields;
+    }
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief Monotonic memory for events. Each thread that builds or changes
+ *        events (the reader, the workers) bump-allocates from its own block;
+ *        every event holds the blocks it was allocated from, and a block is
+ *        recycled once its thread has moved on to a fresh one and the last
+ *        event holding it has been written. Freeing a single value is a
+ *        no-op, so an event costs no malloc() on the reader and no free() on
+ *        a worker. Blocks are carved from one reserved address range, which
+ *        is how their memory is told apart from the heap. Allocations
+ *        outside a Scope, or too large for the rest of the block, go to the
+ *        heap as usual.
+ */
+class EventArena {
+public:
+    struct Block;
+
+    // Blocks one event has allocated from, at most one per thread that
+    // worked on it. Move-only; releases them when destroyed.
+    class Hold {
+    public:
+        Hold() = default;
+        Hold(Hold &&other) noexcept;
+        Hold &operator=(Hold &&other) noexcept;
+        Hold(const Hold &) = delete;
+        Hold &operator=(const Hold &) = delete;
+        ~Hold() { release(); }
+
+        void release();
+
+    private:
+        friend class EventArena;
+        Block *blocks[2]{};
+    };
+
+    // While alive, EventJson/EventString allocations on this thread come
+    // from the thread's current block, which `hold` then keeps. Everything
+    // allocated in the scope must belong to the event of `hold`.
+    class Scope {
+    public:
+        explicit Scope(Hold &hold);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        // Bytes of event values this thread allocated since the scope
+        // opened, arena and heap alike.
+        std::size_t allocated() const;
+
+    private:
+        Block *outer;
+        std::size_t start;
+    };
+
+    static void *allocate(std::size_t bytes, std::size_t align);
+    static void deallocate(void *p) noexcept;
+
+    // Blocks in use and free, and allocations that fell back to the heap.
+    static std::string stats();
+};
+
+/**
+ * @brief Stateless allocator for event values; see EventArena.
+ */
+template <typename T>
+struct EventAllocator {
+    using value_type = T;
+
+    EventAllocator() = default;
+    template <typename U>
+    EventAllocator(const EventAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(EventArena::allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *p, std::size_t) noexcept { EventArena::deallocate(p); }
+
+    template <typename U>
+    bool operator==(const EventAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const EventAllocator<U> &) const noexcept { return false; }
+};
+
+using EventString = std::basic_string<char, std::char_traits<char>, EventAllocator<char>>;
+// nlohmann::json with its nodes, arrays and strings in the arena
+using EventJson = nlohmann::basic_json<std::map, std::vector, EventString, bool, std::int64_t, std::uint64_t,
+                                       double, EventAllocator>;
+
+// Sets `value` to null. A value entirely in arena blocks is abandoned
+// instead of destroyed: nlohmann's destructor moves every element onto a
+// heap-allocated stack first, which is all work for nothing here.
+void discardJson(EventJson &value) noexcept;
@@ -0,0 +1,50 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Config.hpp"
+#include "EventType.hpp"
+
+/**
+ * @brief Decides from the raw frame bytes whether an event is wanted, before
+ *        any JSON is parsed. The `*_event_name` member is located with a
+ *        plain substring scan; the type follows from the key prefix and the
+ *        name is looked up in a per-type perfect hash table built from
+ *        EventConfig::event_names at startup.
+ */
+class EventClassifier {
+public:
+    struct Verdict {
+        EventType type{EventType::Unknown};
+        bool accept{true};
+    };
+
+    // Disabled types (no config) reject all their events.
+    void enable(EventType type, const EventConfig &cfg);
+
+    // Unknown type means the frame could not be classified from its bytes;
+    // such frames are accepted and must be checked again after parsing.
+    Verdict classify(std::string_view frame);
+    bool accepts(EventType type, std::string_view name);
+
+    std::string stats() const;
+
+private:
+    struct NameTable {
+        bool enabled{false};
+        bool allowAll{true};
+        std::uint32_t seed{0};
+        std::vector<std::string> slots; // size is a power of two, "" = empty
+    };
+
+    static std::uint32_t hash(std::string_view s, std::uint32_t seed);
+    static void build(NameTable &table, const std::vector<std::string> &names);
+    bool lookup(const NameTable &table, std::string_view name) const;
+
+    std::array<NameTable, kEventTypeCount> tables{};
+    std::array<std::atomic<std::uint64_t>, kEventTypeCount> rejectedType{};
+    std::array<std::atomic<std::uint64_t>, kEventTypeCount> rejectedName{};
+};
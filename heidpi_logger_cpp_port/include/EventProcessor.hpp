@@ -1,20 +1,68 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "Config.hpp"
+#include "Event.hpp"
+#include "FileWatcher.hpp"
+#include "FlowAggregator.hpp"
 #include "GeoIP.hpp"
 #include "Logger.hpp"
-#include <nlohmann/json.hpp>
+#include "OutputSink.hpp"
+#include "Projection.hpp"
+#include "Rollup.hpp"
 
 /**
  * @brief Processes events based on configuration and writes them as JSON lines.
+ *        The GeoIP database is reopened in the background when its file is
+ *        replaced. Worker threads keep using their own reference to the old
+ *        instance until they notice the new generation or park, so the swap
+ *        never blocks them; the old mapping is closed with its last reference.
+ *        With `aggregate`, each worker thread folds its flows' events into
+ *        per-flow records (FlowAggregator); events of one flow must reach
+ *        the same thread. Rollups count every event into per-window groups
+ *        in addition to, or with `log_events: false` instead of, the log.
  */
 class EventProcessor {
 public:
     EventProcessor(const EventConfig &cfg, const std::string &outDir);
-    void process(const nlohmann::json &j);
+    void process(Event &event);
+    // Call on a worker thread that is about to park: drops its GeoIP
+    // reference so a reload is not held up by idle threads.
+    void idle();
+    ~EventProcessor();
+    // GeoIP cache statistics, empty if there is nothing to report.
+    std::string stats() const;
+    // Aggregation and rollup statistics, empty if not enabled.
+    std::string aggregateStats() const;
+    std::string rollupStats() const;
+    // Writes the records of all flows and windows still open; call once
+    // the workers have stopped.
+    void finish();
 private:
+    bool processRaw(Event &event, const GeoIP *geo);
+    // Timestamp, GeoIP, projection, then out to the sink.
+    void write(EventJson &out, const GeoIP *geo);
+    FlowAggregator &localAggregator();
+    // This thread's reference to the current GeoIP, refreshed after a reload.
+    const GeoIP *currentGeo();
+    void reloadGeo();
+
     EventConfig config;
+    bool raw{false};
     std::string directory;
-    std::unique_ptr<GeoIP> geo;
+    Projection projection;
+    std::uint64_t id{0};
+    mutable std::mutex geoMtx; // guards `geo`, taken once per thread and reload
+    std::shared_ptr<const GeoIP> geo;
+    std::atomic<std::uint64_t> geoGeneration{0};
+    std::unique_ptr<FileWatcher> geoWatcher;
+    std::shared_ptr<OutputSink> sink;
+    mutable std::mutex aggregatorsMtx;
+    std::vector<std::unique_ptr<FlowAggregator>> aggregators; // one per worker thread
+    std::unique_ptr<Rollup> rollup;
 };
 
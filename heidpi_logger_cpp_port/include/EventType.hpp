@@ -0,0 +1,15 @@
+#pragma once
+#include "EventArena.hpp"
+
+/**
+ * @brief The four nDPId event families, identified by their `*_event_name` key.
+ */
+enum class EventType { Flow, Packet, Daemon, Error, Unknown };
+
+constexpr std::size_t kEventTypeCount = 4;
+
+// "flow_event_name", ...; empty for Unknown.
+const char *eventNameKey(EventType type);
+// "flow", "packet", ... for log messages.
+const char *eventTypeName(EventType type);
+EventType classifyEvent(const EventJson &event);
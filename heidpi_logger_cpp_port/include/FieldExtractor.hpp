@@ -0,0 +1,41 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Config.hpp"
+#include "Event.hpp"
+
+// Spare bytes reserved behind Event::raw for SIMD parsers reading past the end.
+constexpr std::size_t kParsePadding = 64;
+
+/**
+ * @brief Set of (possibly nested) member paths a pipeline stage needs.
+ */
+struct FieldSet {
+    struct Node {
+        std::map<std::string, Node, std::less<>> children;
+        bool whole{false}; // the complete value at this path is needed
+    };
+    Node root;
+
+    void add(const std::vector<std::string> &path);
+};
+
+/**
+ * @brief Parse engine used by the reader: fills Event::fields from
+ *        Event::raw with at least the fields in the FieldSet.
+ *        The nlohmann engine always builds the full DOM; the simdjson engine
+ *        (built with HEIDPI_WITH_SIMDJSON) walks the document on demand and
+ *        materialises only the requested fields; it also sets Event::parseDom
+ *        so the worker builds the rest the same way.
+ */
+class FieldExtractor {
+public:
+    virtual ~FieldExtractor() = default;
+    // Returns false if the frame is not valid JSON.
+    virtual bool extract(Event &event) = 0;
+
+    static std::unique_ptr<FieldExtractor> create(ParseEngine engine, const FieldSet &fields);
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Watches one file with inotify and calls back from its own thread
+ *        after the file was rewritten or replaced. The parent directory is
+ *        watched, so replacing the file by rename (the safe way to update
+ *        an mmap'ed database) is seen as well. Changes are debounced: the
+ *        callback runs once no further change came in for `settle`.
+ */
+class FileWatcher {
+public:
+    FileWatcher(const std::string &path, std::function<void()> onChange,
+                std::chrono::milliseconds settle = std::chrono::milliseconds(500));
+    ~FileWatcher();
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+private:
+    void run();
+
+    std::string name; // file name within the watched directory
+    std::function<void()> onChange;
+    std::chrono::milliseconds settle;
+    int inotifyFd{-1};
+    int stopFd{-1}; // eventfd, written by the destructor
+    std::thread thread;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "EventArena.hpp"
+
+/**
+ * @brief Event filter expression compiled once into a flat AST.
+ *
+ *        expr    := expr ('or' | '||') expr | expr ('and' | '&&') expr
+ *                 | ('not' | '!') expr | '(' expr ')'
+ *                 | operand [('==' | '!=' | '<' | '<=' | '>' | '>=') operand]
+ *                 | operand ['not'] 'in' operand
+ *        operand := path | 'string' | "string" | number | true | false | null
+ *                 | '[' literal, ... ']'
+ *        path    := name ('.' name | '[' string ']')*
+ *                                           e.g. ndpi.proto, ndpi['proto']
+ *
+ *        A bare path is true if the field exists. Comparisons involving a
+ *        missing field are false. `x in y` tests list/array membership,
+ *        object keys or substrings, depending on y. A path starting with
+ *        `json_dict` is rooted at the event itself, so the Python logger's
+ *        `'ndpi' in json_dict and 'proto' in json_dict['ndpi']` works as is;
+ *        other Python (calls, indexes, arithmetic) is a syntax error.
+ */
+class FilterExpr {
+public:
+    FilterExpr() = default;
+    // Throws std::runtime_error on syntax errors.
+    static FilterExpr compile(const std::string &text);
+
+    bool empty() const { return nodes.empty(); }
+    bool matches(const EventJson &event) const;
+    // Every field path the expression reads.
+    std::vector<std::vector<std::string>> paths() const;
+
+private:
+    enum class Kind { Or, And, Not, Compare, In, Path, Literal };
+    enum class Op { Eq, Ne, Lt, Le, Gt, Ge };
+
+    struct Node {
+        Kind kind{Kind::Literal};
+        Op op{Op::Eq};
+        int lhs{-1};
+        int rhs{-1};
+        std::vector<std::string> path;
+        EventJson literal;
+    };
+
+    class Parser;
+
+    template <typename T>
+    static bool compare(const T &a, const T &b, Op op);
+
+    bool eval(int node, const EventJson &event) const;
+    const EventJson *operand(int node, const EventJson &event) const;
+
+    std::vector<Node> nodes;
+    int root{-1};
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "EventArena.hpp"
+#include "EventSchema.hpp"
+#include "FlowManager.hpp"
+
+/**
+ * @brief Folds the flow events of each flow into one record that is
+ *        emitted when the flow ends, goes idle, times out or has to make
+ *        room: identity (addresses, ports, protocols), first/last seen,
+ *        packet and payload byte totals, the number of events and the last
+ *        nDPI detection. Flow state comes from a FlowManager. If the state
+ *        outgrows `maxBytes`, the flows due soonest are flushed early and
+ *        marked partial; later events of such a flow start a new record.
+ *        Not thread-safe except for the counters: one per worker thread.
+ */
+class FlowAggregator {
+public:
+    // Receives each finished record; may modify it.
+    using Emit = std::function<void(EventJson &record)>;
+
+    FlowAggregator(std::size_t maxBytes, Emit emit);
+
+    void add(const EventJson &event);
+    // Emits all open flows (app_shutdown).
+    void flush();
+
+    std::size_t flows() const { return manager.size(); }
+    std::size_t memory() const { return bytes.load(std::memory_order_relaxed); }
+    std::uint64_t records() const { return emitted.load(std::memory_order_relaxed); }
+    std::uint64_t evictions() const { return evicted.load(std::memory_order_relaxed); }
+
+private:
+    struct State {
+        std::string srcIp;
+        std::string dstIp;
+        std::string ndpi; // last "ndpi" object, serialized
+        std::uint64_t firstSeen{0};
+        std::uint64_t srcPackets{0};
+        std::uint64_t dstPackets{0};
+        std::uint64_t srcBytes{0};
+        std::uint64_t dstBytes{0};
+        std::uint32_t events{0};
+        std::uint16_t srcPort{0};
+        std::uint16_t dstPort{0};
+        L3Proto l3Proto{L3Proto::Other};
+        L4Proto l4Proto{L4Proto::Other};
+        std::int16_t l4Number{-1}; // l4_proto sent as a protocol number (GRE, SCTP, ...)
+    };
+
+    void merge(State &state, const FlowEventRecord &event);
+    void finish(const FlowManager::Instance &instance, const FlowManager::Flow &flow,
+                FlowManager::CleanupReason reason);
+    static std::size_t heapBytes(const State &state);
+    void account(std::size_t before, std::size_t after);
+
+    std::size_t maxBytes;
+    Emit emit;
+    FlowManager manager;
+    std::vector<State> states;               // by FlowManager slot
+    const FlowEventRecord *current{nullptr}; // event being added
+    std::atomic<std::size_t> bytes{0};
+    std::atomic<std::uint64_t> emitted{0};
+    std::atomic<std::uint64_t> evicted{0};
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "EventArena.hpp"
+#include "EventSchema.hpp"
+#include "EventType.hpp"
+
+/**
+ * @brief Flow state per nDPId instance, port of heiDPIsrvd.FlowManager.
+ *        Flows are keyed by (alias, source, flow_id) and kept as inline
+ *        records in one slab, found through an open-addressing index.
+ *        Timeouts run on a hierarchical timing wheel per instance thread,
+ *        driven by that thread's most recent `thread_ts_usec`, so an event
+ *        costs O(1) instead of a scan over all flows. Not thread-safe
+ *        except for stats().
+ */
+class FlowManager {
+public:
+    // Same values as heiDPIsrvd.FlowManager.CLEANUP_REASON_*
+    enum class CleanupReason : std::uint8_t {
+        Invalid = 0,
+        DaemonInit = 1,
+        DaemonShutdown = 2,
+        FlowEnd = 3,
+        FlowIdle = 4,
+        FlowTimeout = 5,
+        AppShutdown = 6,
+        Evicted = 7, // C++ only: dropped by evict() to bound memory
+    };
+
+    struct Instance {
+        std::string alias;
+        std::string source;
+    };
+
+    struct Flow {
+        std::uint64_t flowId{0};
+        std::uint64_t lastSeen{0}; // usec, latest packet time seen
+        std::uint64_t idleTime{0}; // usec
+        std::uint32_t instance{0};
+        std::uint32_t threadId{0};
+        // Dense index, stable while the flow lives and reused afterwards,
+        // for callers keeping per-flow state in a side array.
+        std::uint32_t slot{0};
+    };
+
+    static constexpr std::uint32_t kNoFlow = 0xffffffff;
+
+    // Called for every flow that is removed, before it is gone. Must not
+    // call back into the manager.
+    using CleanupCallback = std::function<void(const Instance &, const Flow &, CleanupReason)>;
+
+    explicit FlowManager(CleanupCallback onCleanup, std::size_t expectedFlows = 1 << 16);
+    ~FlowManager();
+    FlowManager(const FlowManager &) = delete;
+    FlowManager &operator=(const FlowManager &) = delete;
+
+    // Updates instance clock and flow state from one event of any type and
+    // reports the cleanups it causes: timeouts of flows the clock passed,
+    // all flows of the thread on daemon init/shutdown, the flow itself on
+    // flow end/idle. Uses alias, source, thread_id, thread_ts_usec, flow_id,
+    // flow_idle_time, flow_{src,dst}_last_pkt_time and the event names.
+    // Returns the slot of the event's flow if it is still tracked, else kNoFlow.
+    std::uint32_t update(const FlowEventRecord &event);
+    std::uint32_t update(const PacketEventRecord &event);
+    std::uint32_t update(const DaemonEventRecord &event);
+    std::uint32_t update(const ErrorEventRecord &event);
+    // Reads the record of `type` from `event` first.
+    std::uint32_t update(EventType type, const EventJson &event);
+    // Same, with the type told by the event's *_event_name member.
+    std::uint32_t update(const EventJson &event) { return update(classifyEvent(event), event); }
+    // Removes the flow due soonest on the clock used last (Evicted).
+    // False if there is nothing to remove.
+    bool evict();
+    // Reports all remaining flows as AppShutdown and forgets them.
+    void shutdown();
+
+    std::size_t size() const { return active.load(std::memory_order_relaxed); }
+    std::string stats() const;
+
+    static const char *reasonName(CleanupReason reason);
+
+private:
+    struct Wheel;
+    struct Record;
+    struct Input;
+
+    std::uint32_t apply(const Input &input);
+
+    std::uint32_t instanceOf(std::string_view alias, std::string_view source);
+    Wheel &wheelOf(std::uint32_t instance, std::uint32_t threadId);
+    // timing wheel
+    void schedule(Wheel &wheel, std::uint32_t slot);
+    void unschedule(std::uint32_t slot);
+    void advance(Wheel &wheel, std::uint64_t tick);
+    void cascade(Wheel &wheel, std::uint64_t tick);
+    void drain(Wheel &wheel, CleanupReason reason);
+    // flow table
+    std::uint32_t find(std::uint32_t instance, std::uint64_t flowId) const;
+    std::uint32_t insert(std::uint32_t instance, std::uint64_t flowId);
+    void remove(std::uint32_t slot, CleanupReason reason);
+    void unlinkIndex(std::uint32_t slot);
+    void grow();
+    static std::uint64_t hash(std::uint32_t instance, std::uint64_t flowId);
+
+    CleanupCallback onCleanup;
+    std::vector<Instance> instances;
+    std::unordered_map<std::string, std::uint32_t> instanceIds; // alias + '\0' + source
+    std::uint32_t lastInstance{0xffffffff};
+    // one timing wheel per (instance, thread_id)
+    std::unordered_map<std::uint64_t, std::unique_ptr<Wheel>> wheels;
+    std::uint64_t lastWheelKey{~0ULL};
+    Wheel *lastWheel{nullptr};
+
+    std::vector<Record> slab;
+    std::vector<std::uint32_t> freeSlots;
+    struct Bucket {
+        std::uint32_t slot; // slab index + 1, 0 = empty
+        std::uint32_t tag;  // upper hash bits, saves a slab access per probe
+    };
+    std::vector<Bucket> index;
+    std::size_t mask{0};
+
+    std::atomic<std::size_t> active{0};
+    std::atomic<std::size_t> peak{0};
+    std::array<std::atomic<std::uint64_t>, 8> cleanups{};
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Splits the nDPIsrvd byte stream into frames of the form
+ *        `<decimal length>{...}` without copying the payload.
+ *        Data is received straight into a reusable buffer; complete frames
+ *        are handed out as views into it, a trailing partial frame is moved
+ *        to the front before the next read. The buffer grows only for
+ *        frames larger than its capacity.
+ */
+class FrameDecoder {
+public:
+    explicit FrameDecoder(std::size_t capacity = 256 * 1024);
+
+    // Free space to receive into; call commit() with the bytes written.
+    std::pair<char *, std::size_t> writable();
+    void commit(std::size_t n) { tail += n; }
+
+    // Invokes `cb` for every complete frame (payload without the length
+    // prefix, starting at '{'). Views are valid only during the callback.
+    // Returns false if the stream does not start with a valid prefix.
+    bool drain(const std::function<void(std::string_view)> &cb);
+
+private:
+    std::vector<char> buf;
+    std::size_t head{0};
+    std::size_t tail{0};
+    std::size_t pending{0}; // size of the incomplete frame at head, if known
+};
@@ -1,26 +1,89 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <nlohmann/json.hpp>
+#include <sys/socket.h>
 #include <maxminddb.h>
+#include "CidrTable.hpp"
+#include "Config.hpp"
+#include "EventArena.hpp"
+#include "GeoIPCache.hpp"
+#include "GeoIPTable.hpp"
 
 /**
  * @brief Performs GeoIP lookups using a MaxMind DB and enriches events.
+ *        Two optional caches per calling thread, so lookups take no shared
+ *        lock: finished results by address, and results by MMDB data record,
+ *        which every address of a network shares. A result is built once
+ *        per record; address entries hold a reference to it, not a copy.
+ *        Addresses in reserved or configured networks (CidrTable) get a
+ *        fixed result without touching the database. With the flat table
+ *        enabled the whole database is exported once into a GeoIPTable,
+ *        and the tree walk and caches only serve what it cannot answer.
  */
 class GeoIP {
 public:
     GeoIP() = default;
-    GeoIP(const std::string &path, const std::vector<std::string> &keys);
+    // Uses the geoip_* settings of `cfg`.
+    explicit GeoIP(const EventConfig &cfg);
     ~GeoIP();
+    GeoIP(const GeoIP &) = delete;
+    GeoIP &operator=(const GeoIP &) = delete;
 
-    void enrich(const std::string &src_ip, const std::string &dst_ip,
-                nlohmann::json &out) const;
+    // False if the database could not be opened; enrich() is a no-op then.
+    bool ok() const { return loaded; }
+
+    void enrich(std::string_view src_ip, std::string_view dst_ip, EventJson &out) const;
+    // Same as enrich(), but appends `,"<side>_geoip2_city":{...}` members to
+    // a serialized object whose closing brace has been cut off.
+    void enrichRaw(std::string_view src_ip, std::string_view dst_ip, EventString &line) const;
+
+    // Bypass and cache counters summed over all threads.
+    std::string stats() const;
 
 private:
-    nlohmann::json lookup(const std::string &ip) const;
+    // Configured key such as "country.names.en", split once for MMDB_aget_value.
+    struct KeyPath {
+        std::vector<std::string> parts;
+        std::vector<const char *> path; // into `parts`, null-terminated
+        std::string field;              // last part, the output member name
+    };
+
+    struct ThreadCaches {
+        std::unique_ptr<GeoIPCache> addresses; // by IP address
+        std::unique_ptr<GeoIPCache> records;   // by data section offset
+        std::atomic<std::uint64_t> bypassed{0};
+        std::atomic<std::uint64_t> flat{0}; // answered by the flat table
+    };
+
+    static bool parseAddress(std::string_view ip, sockaddr_storage &addr);
+    // Adds the configured keys found in `record` to `result`, either a
+    // nlohmann::json to cache or an EventJson in the event's arena.
+    template <typename Json>
+    void collect(MMDB_entry_s &record, Json &result) const;
+    // Parsed and serialized result of `record`, null if it has none of the keys.
+    std::shared_ptr<const GeoIPCache::Result> build(MMDB_entry_s &record) const;
+    // Result for `ip`, valid until the next call on this thread. If no
+    // cache would keep a record found in the database, the result is
+    // empty and `uncached` is set to the record for the caller to decode
+    // where it needs it.
+    const GeoIPCache::Result &resolve(std::string_view ip, MMDB_entry_s &uncached) const;
+    ThreadCaches &localCaches() const;
 
     MMDB_s mmdb{};
     bool loaded{false};
-    std::vector<std::string> keys;
+    std::vector<KeyPath> keys;
+    CidrTable bypass;
+    GeoIPTable table;
+    std::uint64_t tableBuildMs{0};
+    std::size_t cacheSize{0};
+    std::size_t recordCacheSize{0};
+    std::uint64_t id{0};
+    mutable std::mutex cachesMtx;
+    mutable std::vector<std::unique_ptr<ThreadCaches>> threadCaches;
 };
-
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief Fixed-size CLOCK cache of finished GeoIP results, keyed by the
+ *        binary address (IPv4 is stored as v4-mapped IPv6) or by MMDB data
+ *        record offset (`hi` = 0). Not thread-safe:
+ *        every worker thread owns its own instance, only the counters are
+ *        read from other threads.
+ */
+class GeoIPCache {
+public:
+    struct Key {
+        std::uint64_t hi{0};
+        std::uint64_t lo{0};
+        bool operator==(const Key &o) const { return hi == o.hi && lo == o.lo; }
+    };
+
+    // A finished lookup, built once per database record and shared by
+    // every entry (and thread-local cache) that has it.
+    struct Result {
+        nlohmann::json value; // the configured keys found, empty if none
+        std::string fragment; // value.dump(), empty if value is
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Result> result; // null if the address is not in the database
+        bool referenced{false};
+        bool owner{false}; // result was built for this entry, counted in memory()
+    };
+
+    explicit GeoIPCache(std::size_t capacity);
+
+    // Key of an AF_INET or AF_INET6 address.
+    static Key keyOf(const sockaddr_storage &addr);
+    // Approximate heap use of a result: its parsed value's containers,
+    // nodes and strings plus the fragment.
+    static std::size_t heapSize(const Result &result);
+
+    Entry *find(const Key &key);
+    // Slot for `key`, evicting another entry if the cache is full. The
+    // caller fills in the result.
+    Entry &insert(const Key &key);
+    // Stores `result` in `entry`. A result no other entry holds yet counts
+    // against this cache; one taken from another entry costs a reference.
+    void fill(Entry &entry, std::shared_ptr<const Result> result);
+
+    std::uint64_t hits() const { return hitCount.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const { return missCount.load(std::memory_order_relaxed); }
+    std::uint64_t evictions() const { return evictionCount.load(std::memory_order_relaxed); }
+    std::size_t size() const { return used.load(std::memory_order_relaxed); }
+    // Approximate heap use of slots, index and the results this cache
+    // built, parsed values included.
+    std::size_t memory() const;
+
+private:
+    static std::size_t hash(const Key &key);
+    void unlink(std::size_t slot);
+
+    std::vector<Entry> slots;
+    std::vector<std::uint32_t> index; // open addressing, slot + 1, 0 = empty
+    std::size_t mask{0};
+    std::size_t hand{0};
+
+    std::atomic<std::uint64_t> hitCount{0};
+    std::atomic<std::uint64_t> missCount{0};
+    std::atomic<std::uint64_t> evictionCount{0};
+    std::atomic<std::size_t> used{0};
+    std::atomic<std::size_t> resultBytes{0};
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <maxminddb.h>
+#include <nlohmann/json.hpp>
+#include "GeoIPCache.hpp"
+
+/**
+ * @brief The configured keys of a whole MMDB flattened into two sorted
+ *        range arrays, IPv4 and IPv6, whose values index deduplicated
+ *        results, each held parsed and serialized. A lookup is a
+ *        branch-free binary search over a contiguous array instead of a
+ *        tree walk plus record decoding. Built once per database, read-only
+ *        afterwards and shared by all threads.
+ */
+class GeoIPTable {
+public:
+    // Fills `result` with the configured keys of one data record.
+    using Collect = std::function<void(MMDB_entry_s &, nlohmann::json &)>;
+
+    // Walks the search tree of `db` once, collecting every data record it
+    // reaches. Returns false and leaves the table empty if the tree is
+    // malformed or the table, together with the maps used while building
+    // it, would need more than `maxBytes`.
+    bool build(const MMDB_s &db, const Collect &collect, std::size_t maxBytes);
+
+    bool empty() const { return v4Start.empty() && v6Start.empty(); }
+    // Result for `key`, with an empty value if there is none; nullptr if
+    // the table cannot answer (IPv6 addresses the database aliases into
+    // the IPv4 tree), ask the MMDB then.
+    const GeoIPCache::Result *find(const GeoIPCache::Key &key) const;
+
+    std::size_t v4Ranges() const { return v4Start.size(); }
+    std::size_t v6Ranges() const { return v6Start.size(); }
+    std::size_t results() const { return entries.size(); }
+    std::size_t memory() const;
+
+private:
+    struct Builder;
+
+    static constexpr std::uint32_t kNone = 0xffffffff;     // not in the database
+    static constexpr std::uint32_t kFallback = 0xfffffffe; // ask the MMDB
+
+    // first address of each range, sorted; ranges cover the whole space
+    std::vector<std::uint32_t> v4Start;
+    std::vector<std::uint32_t> v4Value;
+    std::vector<GeoIPCache::Key> v6Start;
+    std::vector<std::uint32_t> v6Value;
+    std::vector<GeoIPCache::Result> entries; // indexed by the values above
+    GeoIPCache::Result none;                 // for kNone
+    std::size_t entryBytes{0};               // heap use of the entries' contents
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "EventArena.hpp"
+
+/**
+ * @brief Appends JSON text to a caller-owned buffer, byte for byte what
+ *        json::dump() produces (compact, UTF-8 passed through), without
+ *        building a temporary string per value. Strings are scanned 16 bytes
+ *        at a time for characters that need escaping (SSE2, scalar
+ *        elsewhere) and copied in runs; integers go through std::to_chars,
+ *        floating point through nlohmann's own shortest-digits routine so
+ *        doubles keep their exact dump() form. Strings are not re-validated
+ *        as UTF-8; parsed input already was.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string &buffer) : out(buffer) {}
+
+    void value(const EventJson &v);
+    // Quoted and escaped.
+    void string(std::string_view s);
+    // `"name":`
+    void key(std::string_view name) {
+        string(name);
+        out += ':';
+    }
+    void raw(char c) { out += c; }
+    void integer(std::uint64_t v);
+    void integer(std::int64_t v);
+
+private:
+    std::string &out;
+};
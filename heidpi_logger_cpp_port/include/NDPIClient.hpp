@@ -1,11 +1,14 @@
 #pragma once
 #include <functional>
 #include <string>
-#include <nlohmann/json.hpp>
+#include <string_view>
+#include "FrameDecoder.hpp"
 
 /**
  * @brief Simple client for nDPIsrvd server.
- *        Messages are length-prefixed JSON blobs.
+ *        Messages are length-prefixed JSON blobs, received in large
+ *        batches and split by a FrameDecoder. The callback receives the
+ *        raw JSON payload of every frame.
  */
 class NDPIClient {
 public:
@@ -13,8 +16,11 @@ public:
     ~NDPIClient();
     void connectTcp(const std::string &host, unsigned short port);
     void connectUnix(const std::string &path);
-    void loop(const std::function<void(const nlohmann::json &)> &cb, const std::string &filter="");
+    // Async-signal-safe: shuts the socket down so loop() returns.
+    void stop();
+    void loop(const std::function<void(std::string_view)> &cb);
 private:
     int fd{-1};
+    FrameDecoder decoder;
 };
 
@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
+#include "Config.hpp"
+
+/**
+ * @brief Buffered append-only output file shared by all writers of one path.
+ *        Processors only append lines to in-memory chunks; a single writer
+ *        thread hands them to the kernel with one writev per file and batch,
+ *        and syncs according to the durability setting. The FlushPolicy of
+ *        the first event type that opened the path decides when a batch is
+ *        due. If the writer falls behind, write() blocks once a bounded
+ *        amount of data is pending.
+ */
+class OutputSink {
+public:
+    static std::shared_ptr<OutputSink> open(const std::string &path, const FlushPolicy &policy);
+    // Write and sync every sink and stop the writer thread; call before exit.
+    static void closeAll();
+    // Batch size and write/sync latency of every open sink.
+    static std::string stats();
+
+    ~OutputSink();
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    // Append `line` followed by a newline.
+    void write(std::string_view line);
+    // Write everything pending from the calling thread.
+    void flush();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    OutputSink(int fd, const std::string &path, const FlushPolicy &policy);
+    bool dueLocked(Clock::time_point now) const;
+    void sealLocked();
+    void wakeWriterLocked();
+    // Write the pending chunks if a batch is due (always if `force`) and sync
+    // according to the durability setting.
+    void drain(bool force, Clock::time_point now);
+    void writeBatch();
+    void syncIfDue(Clock::time_point now, bool force);
+    static void writerLoop();
+
+    int fd;
+    std::string path;
+    FlushPolicy policy;
+    std::size_t maxPending;
+
+    // guarded by mtx
+    std::mutex mtx;
+    std::condition_variable spaceCv;
+    std::string current;
+    std::vector<std::string> sealed;
+    std::vector<std::string> spare;
+    std::size_t pendingBytes{0};
+    std::size_t pendingLines{0};
+    bool ready{false};
+    Clock::time_point firstPending{};
+
+    // guarded by ioMtx
+    std::mutex ioMtx;
+    std::vector<std::string> batch;
+    std::size_t batchLineCount{0};
+    std::vector<iovec> iov;
+    bool dirty{false};
+    Clock::time_point lastSync{};
+
+    std::atomic<std::uint64_t> batches{0};
+    std::atomic<std::uint64_t> batchLines{0};
+    std::atomic<std::uint64_t> batchBytes{0};
+    std::atomic<std::uint64_t> peakBatchBytes{0};
+    std::atomic<std::uint64_t> writeNs{0};
+    std::atomic<std::uint64_t> peakWriteNs{0};
+    std::atomic<std::uint64_t> syncs{0};
+    std::atomic<std::uint64_t> syncNs{0};
+    std::atomic<std::uint64_t> stalls{0};
+
+    static std::mutex registryMtx;
+    static std::map<std::string, std::shared_ptr<OutputSink>> registry;
+    static std::thread writer;
+    static std::chrono::milliseconds writerTick;
+    static std::atomic<bool> writerActive;
+
+    // Wakes the writer. Writers of a sink only take wakeMtx while the
+    // writer thread announces that it sleeps (see Parker).
+    static std::mutex wakeMtx;
+    static std::condition_variable writerCv;
+    static std::atomic<bool> writerSignalled;
+    static std::atomic<bool> writerSleeping;
+    static std::atomic<bool> stopping;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include "Config.hpp"
+#include "Event.hpp"
+#include "EventType.hpp"
+#include "SpscRing.hpp"
+
+struct QueuedEvent {
+    Event event;
+    std::size_t bytes{0}; // frame and parsed fields, see QueueConfig
+    EventType type{EventType::Unknown};
+};
+
+/**
+ * @brief Bounded queue between the socket reader and the dispatcher that
+ *        enforces QueueConfig when the pipeline falls behind.
+ *
+ *        block         - the reader waits, which backpressures nDPIsrvd via TCP
+ *        drop_oldest   - the reader discards the oldest queued events; it
+ *                        waits if the dispatcher has claimed them all
+ *        drop_priority - packet events are shed from half capacity, flow
+ *                        events at capacity; daemon/error events block
+ *        sample        - from half capacity only `sample_rate` of the events
+ *                        are kept, at capacity all are dropped
+ *
+ *        Slots carry a sequence number so the reader can take the oldest
+ *        event out itself (drop_oldest) while the dispatcher is busy. There is
+ *        one producer; the dispatcher consumes in batches.
+ */
+class OverloadQueue {
+public:
+    explicit OverloadQueue(const QueueConfig &cfg);
+
+    // Reader side. Returns false if the policy dropped the event.
+    bool push(QueuedEvent &&ev);
+
+    // Dispatcher side: moves up to `max` events into `fn`, parking while
+    // empty. Returns 0 once closed and drained.
+    template <typename Fn>
+    std::size_t waitPopBatch(Fn &&fn, std::size_t max) {
+        while (true) {
+            std::size_t start = 0;
+            std::size_t n = claim(start, max);
+            if (n > 0) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    QueuedEvent ev = take(start + i);
+                    fn(std::move(ev));
+                }
+                producer.wake();
+                return n;
+            }
+            if (closed.load(std::memory_order_acquire) && depth() == 0) return 0;
+            consumer.wait([&] {
+                return closed.load(std::memory_order_acquire) || ready(head.load(std::memory_order_acquire));
+            });
+        }
+    }
+
+    void close();
+    std::size_t depth() const {
+        std::size_t h = head.load(std::memory_order_acquire);
+        std::size_t t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+    std::string stats();
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> seq{0};
+        QueuedEvent item;
+    };
+
+    bool ready(std::size_t index) const {
+        return slots[index & mask].seq.load(std::memory_order_acquire) == index + 1;
+    }
+    std::size_t claim(std::size_t &start, std::size_t max);
+    QueuedEvent take(std::size_t index);
+    bool full(std::size_t incomingBytes) const;
+    double usage() const;
+    bool dropOldest();
+    void waitForRoom(std::size_t incomingBytes);
+    void drop(EventType type);
+
+    QueueConfig config;
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask{0};
+    std::atomic<bool> closed{false};
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::atomic<std::size_t> bytes{0};
+    Parker consumer;
+    Parker producer;
+
+    std::minstd_rand rng{std::random_device{}()}; // reader only
+    std::atomic<std::size_t> peakDepth{0};
+    std::atomic<std::size_t> peakBytes{0};
+
+    std::array<std::atomic<std::uint64_t>, kEventTypeCount + 1> dropped{};
+    std::atomic<std::uint64_t> blocked{0};
+};
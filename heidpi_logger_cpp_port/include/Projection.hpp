@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "EventArena.hpp"
+
+/**
+ * @brief Which members of an event are written, compiled once from
+ *        ignore_fields, ignore_risks and keep_fields into a tree of dotted
+ *        paths. serialize() applies it while writing the JSON line, so
+ *        removed members are neither copied nor erased. With keep paths,
+ *        only those subtrees are written (minus dropped paths within them).
+ *        Output is byte-identical to json::dump() of the projected event.
+ */
+class Projection {
+public:
+    Projection();
+    // `risks` are flow risk ids, dropped below ndpi.flow_risk.
+    Projection(const std::vector<std::string> &keep, const std::vector<std::string> &drop,
+               const std::vector<std::string> &risks);
+    Projection(Projection &&) noexcept;
+    Projection &operator=(Projection &&) noexcept;
+    ~Projection();
+
+    // True if every event is written unchanged.
+    bool empty() const { return !root; }
+    // Appends the projected `event` to `out`.
+    void serialize(const EventJson &event, std::string &out) const;
+
+private:
+    struct Node;
+    class Writer;
+
+    Node &path(const std::string &dotted);
+
+    std::unique_ptr<Node> root;
+    bool keepOnly{false};
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Config.hpp"
+#include "EventArena.hpp"
+#include "FlowManager.hpp"
+#include "GeoIP.hpp"
+#include "Sketch.hpp"
+
+/**
+ * @brief Tumbling-window rollups of one event type: events, flows, packets
+ *        and payload bytes per window and combination of `group_by` field
+ *        values, written as one JSON-lines or CSV file per window.
+ *        Windows are processing time: an event counts for the window in
+ *        which a worker handles it, not by nDPId's timestamps.
+ *        Each worker thread counts into its own table, sized up front for
+ *        `max_groups`; a collector thread merges the tables once a window
+ *        has closed and writes the file. Packets and bytes are what nDPId's
+ *        running per-flow totals grew by since the flow's previous event,
+ *        tracked per thread with a FlowManager so finished flows are
+ *        forgotten. Group values may come from the GeoIP enrichment
+ *        (`src_geoip2_city.en`). Optionally each window also gets fixed-size
+ *        address sketches: top-K src_ip/dst_ip by new flows and by payload
+ *        bytes (Count-Min + heap) and distinct src_ip/dst_ip (HyperLogLog),
+ *        written to a `_sketch.json` file next to the window's rollup.
+ */
+class Rollup {
+public:
+    Rollup(const EventConfig &cfg, const std::string &outDir);
+    ~Rollup();
+    Rollup(const Rollup &) = delete;
+    Rollup &operator=(const Rollup &) = delete;
+
+    // GeoIP group values are looked up with `geo`, or read from the
+    // event's own src_geoip2_city/dst_geoip2_city members if it is null.
+    void add(const EventJson &event, const GeoIP *geo);
+    // Writes every window still open and stops the collector; call once
+    // the workers have stopped.
+    void finish();
+    std::string stats() const;
+
+private:
+    struct Counters {
+        std::uint64_t events{0};
+        std::uint64_t flows{0};
+        std::uint64_t packets{0};
+        std::uint64_t bytes{0};
+    };
+    class Table;
+    struct Sketches;
+    struct Local;
+
+    Local &local();
+    std::int64_t windowOf(std::chrono::system_clock::time_point t) const;
+    // Group values joined into one key; GeoIP paths are read from `geo`.
+    void buildKey(const EventJson &event, const EventJson *geo, std::string &key) const;
+    void run();
+    // Merges and writes all windows up to and including `last`.
+    void collect(std::int64_t last);
+    void write(std::int64_t window, const std::map<std::string, Counters> &groups);
+    void sketch(Local &local, const EventJson &event, std::int64_t window);
+    void writeSketches(std::int64_t window, const Sketches &sum);
+
+    std::uint64_t id{0};
+    std::int64_t width;                          // seconds
+    std::vector<std::string> names;              // as configured
+    std::vector<std::vector<std::string>> paths; // split at '.'
+    std::size_t maxGroups;
+    bool csv;
+    std::size_t topK;
+    bool distinctIps;
+    std::size_t sketchWidth;
+    std::string basePath; // directory/filename, window start and extension appended
+    bool needsGeo{false};
+
+    mutable std::mutex localsMtx;
+    std::vector<std::unique_ptr<Local>> locals; // one per worker thread
+
+    std::mutex collectorMtx;
+    std::condition_variable collectorCv;
+    bool stopping{false};
+    std::thread collector;
+    std::mutex writeMtx; // collector vs. finish()
+
+    std::atomic<std::uint64_t> windowsWritten{0};
+    std::atomic<std::uint64_t> rowsWritten{0};
+    std::atomic<std::uint64_t> dropped{0}; // events whose group row did not fit, sketched anyway
+};
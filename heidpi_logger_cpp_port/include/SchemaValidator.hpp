@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "Config.hpp"
+#include "EventType.hpp"
+#include "SpscRing.hpp"
+
+/**
+ * @brief Checks a sample of the received events against the nDPId event
+ *        schemas without slowing the logging path down. Each schema is
+ *        compiled once. offer() keeps `sample_rate` of the events as a copy
+ *        of the frame in a bounded ring, skipping them while it is full; a
+ *        thread at idle priority parses and validates them and counts the
+ *        violations per schema and member. Types whose schema could not be
+ *        loaded are not sampled. offer() must only be called from one thread
+ *        (the reader).
+ */
+class SchemaValidator {
+public:
+    explicit SchemaValidator(const SchemaValidationConfig &cfg);
+    ~SchemaValidator();
+    SchemaValidator(const SchemaValidator &) = delete;
+    SchemaValidator &operator=(const SchemaValidator &) = delete;
+
+    void offer(EventType type, std::string_view frame);
+    // Validates what is still queued, then joins the thread.
+    void stop();
+
+    std::string stats() const;
+
+private:
+    struct Sample {
+        EventType type{EventType::Unknown};
+        std::string frame;
+    };
+    struct Schema;
+
+    void run();
+    void validate(const Sample &sample);
+    void count(EventType type, const std::string &member, const std::string &message);
+
+    SchemaValidationConfig config;
+    std::array<std::unique_ptr<Schema>, kEventTypeCount> schemas;
+    SpscRing<Sample> ring;
+    std::minstd_rand rng{std::random_device{}()}; // offer() only
+    std::thread thread;
+
+    std::atomic<std::uint64_t> sampled{0};
+    std::atomic<std::uint64_t> skipped{0};    // ring full
+    std::atomic<std::uint64_t> validated{0};
+    std::atomic<std::uint64_t> invalid{0};    // events with at least one violation
+    std::atomic<std::uint64_t> unparsable{0};
+    mutable std::mutex violationsMtx;
+    std::map<std::string, std::uint64_t> violations; // "flow/ndpi/proto" -> count
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Event.hpp"
+#include "SpscRing.hpp"
+
+/**
+ * @brief Fixed set of worker threads, each fed by its own SpscRing.
+ *        Events are assigned to a shard by key (the flow id), so all events
+ *        of one flow are handled in order by the same thread. submit() must
+ *        only be called from one thread (the dispatcher).
+ */
+class ShardedPool {
+public:
+    using Handler = std::function<void(Event &)>;
+    // Called on a worker thread before it parks on its empty ring.
+    using Idle = std::function<void()>;
+
+    ShardedPool(std::size_t shards, std::size_t shardCapacity, Handler handler, Idle idle = nullptr);
+    ~ShardedPool();
+
+    void submit(std::uint64_t key, Event &&event);
+    // Process everything still queued, then join the threads.
+    void stop();
+
+    std::size_t size() const { return shards.size(); }
+    // Current queue depth and the peak since the last stats() call.
+    std::size_t depth(std::size_t shard) const;
+    std::string stats();
+
+private:
+    struct Shard {
+        explicit Shard(std::size_t capacity) : ring(capacity) {}
+        SpscRing<Event> ring;
+        std::thread thread;
+        std::atomic<std::size_t> peak{0};
+        std::atomic<std::uint64_t> processed{0};
+    };
+
+    void run(Shard &shard);
+
+    Handler handler;
+    Idle idle;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Fixed-size stream summaries for keys that are too many to count
+ *        exactly (addresses under scanning traffic). Keys are passed as a
+ *        64-bit hash from sketchHash(); sketches of the same shape can be
+ *        merged, so worker threads keep their own and a collector sums them.
+ */
+std::uint64_t sketchHash(std::string_view key);
+
+/**
+ * @brief Count-Min sketch: `depth` rows of `width` counters. Estimates never
+ *        undercount; they overcount by at most 2.7/width of the total with
+ *        probability 1 - 2^-depth (e/width, e^-depth).
+ */
+class CountMinSketch {
+public:
+    CountMinSketch(std::size_t width, std::size_t depth);
+    void add(std::uint64_t hash, std::uint64_t count);
+    std::uint64_t estimate(std::uint64_t hash) const;
+    void merge(const CountMinSketch &other);
+    void clear();
+    std::size_t memory() const { return counters.size() * sizeof(std::uint64_t); }
+
+private:
+    std::size_t width; // power of two
+    std::size_t depth;
+    std::vector<std::uint64_t> counters; // row-major
+};
+
+/**
+ * @brief HyperLogLog distinct counter with 2^precision one-byte registers,
+ *        standard error about 1.04/sqrt(2^precision); linear counting while
+ *        the set is small.
+ */
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned precision = 14);
+    void add(std::uint64_t hash);
+    std::uint64_t estimate() const;
+    void merge(const HyperLogLog &other);
+    void clear();
+    std::size_t memory() const { return registers.size(); }
+
+private:
+    unsigned precision;
+    std::vector<std::uint8_t> registers;
+};
+
+/**
+ * @brief The `k` heaviest keys seen, by the latest count offered for them
+ *        (usually a Count-Min estimate). Min-heap on the count; lookups
+ *        are a scan by hash, cheap for the small k this is meant for.
+ */
+class TopK {
+public:
+    struct Item {
+        std::string key;
+        std::uint64_t hash{0};
+        std::uint64_t count{0};
+    };
+
+    explicit TopK(std::size_t k);
+    void offer(std::string_view key, std::uint64_t hash, std::uint64_t count);
+    // Heaviest first.
+    std::vector<Item> sorted() const;
+    const std::vector<Item> &items() const { return heap; }
+    void clear() { heap.clear(); }
+
+private:
+    void siftUp(std::size_t i);
+    void siftDown(std::size_t i);
+
+    std::size_t k;
+    std::vector<Item> heap;
+};
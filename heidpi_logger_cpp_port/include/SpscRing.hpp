@@ -0,0 +1,152 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Spin-then-park wait used by both ends of an SpscRing.
+ *        A waiter spins briefly and then sleeps on a condition variable.
+ *        The other side only takes the mutex when a waiter announced
+ *        that it is asleep, so a busy ring never enters the kernel.
+ */
+class Parker {
+public:
+    template <typename Pred>
+    void wait(Pred ready) {
+        wait(ready, [] {});
+    }
+
+    // As above; `beforeSleep` runs once the spinning is over, before the
+    // thread blocks.
+    template <typename Pred, typename Idle>
+    void wait(Pred ready, Idle beforeSleep) {
+        for (int i = 0; i < kSpins; ++i) {
+            if (ready()) return;
+            if (i >= kSpins / 2) std::this_thread::yield();
+        }
+        beforeSleep();
+        std::unique_lock<std::mutex> lk(mtx);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready()) cv.wait(lk);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    // Call after publishing the state change `wait` is waiting for.
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping.load(std::memory_order_relaxed)) return;
+        { std::lock_guard<std::mutex> lk(mtx); }
+        cv.notify_one();
+    }
+
+private:
+    static constexpr int kSpins = 256;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<bool> sleeping{false};
+};
+
+/**
+ * @brief Bounded lock-free single-producer/single-consumer ring.
+ *        The consumer takes items out in batches; both ends block with a
+ *        Parker when the ring is empty or full.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t minCapacity) {
+        std::size_t cap = 2;
+        while (cap < minCapacity) cap <<= 1;
+        mask = cap - 1;
+        slots = std::make_unique<T[]>(cap);
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+    std::size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    bool tryPush(T &&item) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache > mask) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache > mask) return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        consumer.wake();
+        return true;
+    }
+
+    // Blocks while the ring is full. Returns false once the ring is closed.
+    bool push(T &&item) {
+        while (!tryPush(std::move(item))) {
+            if (closed.load(std::memory_order_acquire)) return false;
+            producer.wait([&] {
+                return closed.load(std::memory_order_acquire) ||
+                       tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) <= mask;
+            });
+        }
+        return true;
+    }
+
+    // Moves up to `max` items into `fn` without blocking; returns the count.
+    template <typename Fn>
+    std::size_t popBatch(Fn &&fn, std::size_t max) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (tailCache == h) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (tailCache == h) return 0;
+        }
+        std::size_t n = tailCache - h;
+        if (n > max) n = max;
+        for (std::size_t i = 0; i < n; ++i) {
+            fn(std::move(slots[(h + i) & mask]));
+        }
+        head.store(h + n, std::memory_order_release);
+        producer.wake();
+        return n;
+    }
+
+    // Like popBatch, but parks while empty. Returns 0 once closed and drained.
+    template <typename Fn>
+    std::size_t waitPopBatch(Fn &&fn, std::size_t max) {
+        return waitPopBatch(fn, max, [] {});
+    }
+
+    // As above; `beforeSleep` runs each time the consumer is about to block.
+    template <typename Fn, typename Idle>
+    std::size_t waitPopBatch(Fn &&fn, std::size_t max, Idle beforeSleep) {
+        while (true) {
+            std::size_t n = popBatch(fn, max);
+            if (n > 0) return n;
+            if (closed.load(std::memory_order_acquire) && size() == 0) return 0;
+            consumer.wait([&] {
+                return closed.load(std::memory_order_acquire) ||
+                       tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed);
+            }, beforeSleep);
+        }
+    }
+
+    // No further pushes; the consumer drains what is left and then stops.
+    void close() {
+        closed.store(true, std::memory_order_release);
+        consumer.wake();
+        producer.wake();
+    }
+
+private:
+    std::unique_ptr<T[]> slots;
+    std::size_t mask{0};
+    std::atomic<bool> closed{false};
+    alignas(64) std::atomic<std::size_t> head{0}; // consumer position
+    std::size_t tailCache{0};                     // consumer's view of tail
+    alignas(64) std::atomic<std::size_t> tail{0}; // producer position
+    std::size_t headCache{0};                     // producer's view of head
+    alignas(64) Parker consumer;
+    Parker producer;
+};
@@ -0,0 +1,133 @@
+#include "CidrTable.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <endian.h>
+
+namespace {
+using Key = GeoIPCache::Key;
+
+bool less(const Key &a, const Key &b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool isMax(const Key &k) {
+    return k.hi == ~0ULL && k.lo == ~0ULL;
+}
+
+Key next(Key k) {
+    if (++k.lo == 0) ++k.hi;
+    return k;
+}
+
+Key prev(Key k) {
+    if (k.lo-- == 0) --k.hi;
+    return k;
+}
+
+const char *const kReserved[] = {
+    "0.0.0.0/8",       "10.0.0.0/8",      "100.64.0.0/10",   "127.0.0.0/8",
+    "169.254.0.0/16",  "172.16.0.0/12",   "192.0.0.0/24",    "192.0.2.0/24",
+    "192.88.99.0/24",  "192.168.0.0/16",  "198.18.0.0/15",   "198.51.100.0/24",
+    "203.0.113.0/24",  "224.0.0.0/4",     "240.0.0.0/4",
+    "::/128",          "::1/128",         "64:ff9b:1::/48",  "100::/64",
+    "2001:db8::/32",   "fc00::/7",        "fe80::/10",       "ff00::/8",
+};
+} // namespace
+
+void CidrTable::addReserved() {
+    for (const char *cidr : kReserved) add(cidr, nullptr);
+}
+
+void CidrTable::add(const std::string &cidr, const nlohmann::json &label) {
+    auto slash = cidr.find('/');
+    std::string ip = cidr.substr(0, slash);
+    bool v6 = ip.find(':') != std::string::npos;
+    unsigned char bytes[16] = {};
+    if (!v6) {
+        bytes[10] = 0xff;
+        bytes[11] = 0xff;
+    }
+    if (inet_pton(v6 ? AF_INET6 : AF_INET, ip.c_str(), v6 ? bytes : bytes + 12) != 1) {
+        throw std::runtime_error("invalid CIDR: " + cidr);
+    }
+    unsigned maxLen = v6 ? 128 : 32;
+    unsigned len = maxLen;
+    if (slash != std::string::npos) {
+        std::size_t used = 0;
+        unsigned long n = 0;
+        try {
+            n = std::stoul(cidr.substr(slash + 1), &used);
+        } catch (const std::exception &) {
+            used = 0;
+        }
+        if (used == 0 || used != cidr.size() - slash - 1 || n > maxLen) {
+            throw std::runtime_error("invalid CIDR: " + cidr);
+        }
+        len = static_cast<unsigned>(n);
+    }
+    if (!v6) len += 96;
+
+    std::uint64_t hiHalf, loHalf;
+    std::memcpy(&hiHalf, bytes, 8);
+    std::memcpy(&loHalf, bytes + 8, 8);
+    Key addr{be64toh(hiHalf), be64toh(loHalf)};
+    std::uint64_t hiMask = len >= 64 ? ~0ULL : (len == 0 ? 0 : ~0ULL << (64 - len));
+    std::uint64_t loMask = len <= 64 ? 0 : (len == 128 ? ~0ULL : ~0ULL << (128 - len));
+
+    GeoIPCache::Result result;
+    result.value = label;
+    if (!label.is_null()) result.fragment = label.dump();
+    labels.push_back(std::move(result));
+    prefixes.push_back({{addr.hi & hiMask, addr.lo & loMask},
+                        {addr.hi | ~hiMask, addr.lo | ~loMask},
+                        static_cast<std::uint32_t>(labels.size() - 1)});
+}
+
+void CidrTable::build() {
+    // Prefixes are nested or disjoint. Sorted by start, outer first (and
+    // among identical ones in insertion order), a sweep with a stack of open
+    // prefixes yields disjoint ranges labelled by the innermost one.
+    std::stable_sort(prefixes.begin(), prefixes.end(), [](const Range &a, const Range &b) {
+        if (less(a.lo, b.lo) || less(b.lo, a.lo)) return less(a.lo, b.lo);
+        return less(b.hi, a.hi);
+    });
+    ranges.clear();
+    std::vector<const Range *> open;
+    Key cursor{};
+    bool done = false; // cursor ran past the last address
+    auto emit = [&](const Key &hi, std::uint32_t label) {
+        if (done || less(hi, cursor)) return;
+        if (!ranges.empty() && ranges.back().label == label && next(ranges.back().hi) == cursor) {
+            ranges.back().hi = hi;
+        } else {
+            ranges.push_back({cursor, hi, label});
+        }
+        done = isMax(hi);
+        cursor = next(hi);
+    };
+    auto closeUntil = [&](const Key *start) {
+        while (!open.empty() && (!start || less(open.back()->hi, *start))) {
+            emit(open.back()->hi, open.back()->label);
+            open.pop_back();
+        }
+    };
+    for (const auto &p : prefixes) {
+        closeUntil(&p.lo);
+        if (!open.empty() && less(cursor, p.lo)) emit(prev(p.lo), open.back()->label);
+        cursor = p.lo;
+        done = false;
+        open.push_back(&p);
+    }
+    closeUntil(nullptr);
+}
+
+const GeoIPCache::Result *CidrTable::find(const Key &key) const {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), key,
+                               [](const Key &k, const Range &r) { return less(k, r.lo); });
+    if (it == ranges.begin()) return nullptr;
+    --it;
+    if (less(it->hi, key)) return nullptr;
+    return &labels[it->label];
+}
@@ -1,4 +1,28 @@
 #include "Config.hpp"
+#include <map>
+#include <stdexcept>
+
+static FlushPolicy::Mode parseFlushMode(const std::string &name) {
+    if (name == "bytes") return FlushPolicy::Mode::Bytes;
+    if (name == "interval") return FlushPolicy::Mode::Interval;
+    if (name == "event") return FlushPolicy::Mode::Event;
+    throw std::runtime_error("unknown flush policy: " + name);
+}
+
+static FlushPolicy::Durability parseDurability(const std::string &name) {
+    if (name == "none") return FlushPolicy::Durability::None;
+    if (name == "interval") return FlushPolicy::Durability::Interval;
+    if (name == "batch") return FlushPolicy::Durability::Batch;
+    throw std::runtime_error("unknown durability: " + name);
+}
+
+static QueueConfig::Policy parseQueuePolicy(const std::string &name) {
+    if (name == "block") return QueueConfig::Policy::Block;
+    if (name == "drop_oldest") return QueueConfig::Policy::DropOldest;
+    if (name == "drop_priority") return QueueConfig::Policy::DropPriority;
+    if (name == "sample") return QueueConfig::Policy::Sample;
+    throw std::runtime_error("unknown queue policy: " + name);
+}
 
 Config::Config(const std::string &path) {
     YAML::Node config = YAML::LoadFile(path);
@@ -8,27 +32,107 @@ Config::Config(const std::string &path) {
         logging_cfg.format = logNode["format"].as<std::string>("%Y-%m-%dT%H:%M:%S");
         logging_cfg.datefmt = logNode["datefmt"].as<std::string>("%Y-%m-%dT%H:%M:%S");
         if (logNode["filename"]) logging_cfg.filename = logNode["filename"].as<std::string>();
+        if (logNode["stats_interval"]) logging_cfg.stats_interval = logNode["stats_interval"].as<int>();
+    }
+
+    auto queueNode = config["queue"];
+    if (queueNode) {
+        if (queueNode["capacity_events"]) queue_cfg.capacity_events = queueNode["capacity_events"].as<std::size_t>();
+        if (queueNode["capacity_bytes"]) queue_cfg.capacity_bytes = queueNode["capacity_bytes"].as<std::size_t>();
+        if (queueNode["policy"]) queue_cfg.policy = parseQueuePolicy(queueNode["policy"].as<std::string>());
+        if (queueNode["sample_rate"]) queue_cfg.sample_rate = queueNode["sample_rate"].as<double>();
+    }
+
+    if (config["parser"]) {
+        auto engine = config["parser"].as<std::string>();
+        if (engine == "nlohmann") parse_engine = ParseEngine::Nlohmann;
+        else if (engine == "simdjson") parse_engine = ParseEngine::Simdjson;
+        else throw std::runtime_error("unknown parser: " + engine);
+    }
+
+    if (auto tracking = config["flow_tracking"]) {
+        if (tracking["enabled"]) flow_tracking_cfg.enabled = tracking["enabled"].as<bool>();
+        if (tracking["expected_flows"]) flow_tracking_cfg.expected_flows = tracking["expected_flows"].as<std::size_t>();
+    }
+
+    if (auto validation = config["schema_validation"]) {
+        auto &v = schema_validation_cfg;
+        if (validation["enabled"]) v.enabled = validation["enabled"].as<bool>();
+        if (validation["sample_rate"]) v.sample_rate = validation["sample_rate"].as<double>();
+        if (validation["queue_size"]) v.queue_size = validation["queue_size"].as<std::size_t>();
+        if (validation["schema_dir"]) v.schema_dir = validation["schema_dir"].as<std::string>();
+        if (v.sample_rate < 0.0 || v.sample_rate > 1.0) throw std::runtime_error("schema_validation.sample_rate must be in [0, 1]");
     }
 
     auto parseEvent = [](const YAML::Node &node, EventConfig &cfg) {
         if (!node) return;
         if (node["ignore_fields"]) cfg.ignore_fields = node["ignore_fields"].as<std::vector<std::string>>();
         if (node["ignore_risks"]) cfg.ignore_risks = node["ignore_risks"].as<std::vector<std::string>>();
+        if (node["keep_fields"]) cfg.keep_fields = node["keep_fields"].as<std::vector<std::string>>();
         if (node["flow_event_name"]) cfg.event_names = node["flow_event_name"].as<std::vector<std::string>>();
         if (node["packet_event_name"]) cfg.event_names = node["packet_event_name"].as<std::vector<std::string>>();
         if (node["daemon_event_name"]) cfg.event_names = node["daemon_event_name"].as<std::vector<std::string>>();
         if (node["error_event_name"]) cfg.event_names = node["error_event_name"].as<std::vector<std::string>>();
         if (node["filename"]) cfg.filename = node["filename"].as<std::string>();
         if (node["threads"]) cfg.threads = node["threads"].as<int>();
+        if (node["raw_output"]) cfg.raw_output = node["raw_output"].as<bool>();
+        if (node["log_events"]) cfg.log_events = node["log_events"].as<bool>();
+        if (auto rollup = node["rollup"]) {
+            if (rollup["enabled"]) cfg.rollup = rollup["enabled"].as<bool>();
+            if (rollup["window_seconds"]) cfg.rollup_window_seconds = rollup["window_seconds"].as<int>();
+            if (rollup["group_by"]) cfg.rollup_group_by = rollup["group_by"].as<std::vector<std::string>>();
+            if (rollup["max_groups"]) cfg.rollup_max_groups = rollup["max_groups"].as<std::size_t>();
+            if (rollup["format"]) {
+                auto format = rollup["format"].as<std::string>();
+                if (format != "json" && format != "csv") throw std::runtime_error("unknown rollup format: " + format);
+                cfg.rollup_csv = format == "csv";
+            }
+            if (rollup["filename"]) cfg.rollup_filename = rollup["filename"].as<std::string>();
+            if (rollup["top_k"]) cfg.rollup_top_k = rollup["top_k"].as<std::size_t>();
+            if (rollup["distinct_ips"]) cfg.rollup_distinct_ips = rollup["distinct_ips"].as<bool>();
+            if (rollup["sketch_width"]) cfg.rollup_sketch_width = rollup["sketch_width"].as<std::size_t>();
+        }
+        if (node["flush"]) {
+            auto flush = node["flush"];
+            if (flush["policy"]) cfg.flush.mode = parseFlushMode(flush["policy"].as<std::string>());
+            if (flush["bytes"]) cfg.flush.bytes = flush["bytes"].as<std::size_t>();
+            if (flush["interval_ms"]) cfg.flush.interval_ms = flush["interval_ms"].as<int>();
+            if (flush["durability"]) cfg.flush.durability = parseDurability(flush["durability"].as<std::string>());
+            if (flush["sync_interval_ms"]) cfg.flush.sync_interval_ms = flush["sync_interval_ms"].as<int>();
+        }
         if (node["geoip2_city"]) {
             auto geo = node["geoip2_city"];
             cfg.geoip_enabled = geo["enabled"].as<bool>(false);
             if (geo["filepath"]) cfg.geoip_path = geo["filepath"].as<std::string>();
             if (geo["keys"]) cfg.geoip_keys = geo["keys"].as<std::vector<std::string>>();
+            if (geo["reload"]) cfg.geoip_reload = geo["reload"].as<bool>();
+            if (geo["cache_size"]) cfg.geoip_cache_size = geo["cache_size"].as<std::size_t>();
+            if (geo["record_cache_size"]) cfg.geoip_record_cache_size = geo["record_cache_size"].as<std::size_t>();
+            if (geo["flat_table"]) cfg.geoip_flat_table = geo["flat_table"].as<bool>();
+            if (geo["flat_table_max_mb"]) cfg.geoip_flat_table_max_mb = geo["flat_table_max_mb"].as<std::size_t>();
+            if (auto bypass = geo["bypass"]) {
+                if (bypass["reserved"]) cfg.geoip_bypass_reserved = bypass["reserved"].as<bool>();
+                for (const auto &range : bypass["ranges"]) {
+                    nlohmann::json label;
+                    if (range["label"]) {
+                        for (const auto &kv : range["label"].as<std::map<std::string, std::string>>()) {
+                            label[kv.first] = kv.second;
+                        }
+                    }
+                    cfg.geoip_bypass.emplace_back(range["cidr"].as<std::string>(), label);
+                }
+            }
         }
     };
 
     parseEvent(config["flow_event"], flow_cfg);
+    // per-flow records only make sense for flow events
+    if (config["flow_event"] && config["flow_event"]["aggregate"]) {
+        auto aggregate = config["flow_event"]["aggregate"];
+        if (aggregate["enabled"]) flow_cfg.aggregate = aggregate["enabled"].as<bool>();
+        if (aggregate["max_mb"]) flow_cfg.aggregate_max_mb = aggregate["max_mb"].as<std::size_t>();
+        if (aggregate["keep_events"]) flow_cfg.aggregate_keep_events = aggregate["keep_events"].as<bool>();
+    }
     parseEvent(config["packet_event"], packet_cfg);
     parseEvent(config["daemon_event"], daemon_cfg);
     parseEvent(config["error_event"], error_cfg);
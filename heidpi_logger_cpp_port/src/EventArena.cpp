@@ -0,0 +1,220 @@
+#include "EventArena.hpp"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <sys/mman.h>
+
+namespace {
+constexpr std::size_t kBlockSize = 256 * 1024;
+// reserved once; pages are only backed when a block is first used
+constexpr std::size_t kRegionSize = std::size_t{1} << 30;
+// a thread moves to a fresh block before an event with less room than this
+constexpr std::size_t kMinFree = 16 * 1024;
+// free blocks beyond this many give their pages back to the kernel
+constexpr std::size_t kKeepFree = 64;
+constexpr std::size_t kPage = 4096;
+}
+
+struct EventArena::Block {
+    std::atomic<std::uint32_t> refs{0}; // the thread using it plus holding events
+    std::size_t used{0};
+    Block *next{nullptr}; // free list
+};
+
+namespace {
+using Block = EventArena::Block;
+constexpr std::size_t kHeader = (sizeof(Block) + 63) & ~std::size_t{63};
+
+struct Region {
+    Region() {
+        void *p = ::mmap(nullptr, kRegionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                         -1, 0);
+        if (p == MAP_FAILED) return; // no arena, everything goes to the heap
+        begin = reinterpret_cast<std::uintptr_t>(p);
+        end = begin + kRegionSize;
+    }
+    // never unmapped: late destructors may still free into it
+    bool owns(const void *p) const {
+        auto at = reinterpret_cast<std::uintptr_t>(p);
+        return at >= begin && at < end;
+    }
+
+    std::uintptr_t begin{0};
+    std::uintptr_t end{0};
+    std::mutex mtx; // guards the members below
+    Block *free{nullptr};
+    std::size_t carved{0};
+    std::size_t freeCount{0};
+    std::atomic<std::uint64_t> spilled{0};
+};
+Region region;
+
+Block *take() {
+    std::lock_guard<std::mutex> lock(region.mtx);
+    Block *block = region.free;
+    if (block) {
+        region.free = block->next;
+        --region.freeCount;
+    } else {
+        if (region.begin == 0 || (region.carved + 1) * kBlockSize > kRegionSize) return nullptr;
+        block = new (reinterpret_cast<void *>(region.begin + region.carved * kBlockSize)) Block();
+        ++region.carved;
+    }
+    block->refs.store(1, std::memory_order_relaxed);
+    block->used = kHeader;
+    block->next = nullptr;
+    return block;
+}
+
+void release(Block *block) {
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    std::lock_guard<std::mutex> lock(region.mtx);
+    if (region.freeCount >= kKeepFree) {
+        // keep the page with the header, drop the rest
+        ::madvise(reinterpret_cast<char *>(block) + kPage, kBlockSize - kPage, MADV_DONTNEED);
+    }
+    block->next = region.free;
+    region.free = block;
+    ++region.freeCount;
+}
+
+// block allocations go to while a Scope is open
+thread_local Block *active = nullptr;
+// event value bytes this thread has allocated, for Scope::allocated()
+thread_local std::size_t allocatedBytes = 0;
+
+// The block new events of this thread start in; the thread holds one
+// reference to it until it moves on.
+struct Current {
+    Block *block{nullptr};
+    ~Current() {
+        if (block) release(block);
+    }
+};
+thread_local Current current;
+} // namespace
+
+void EventArena::Hold::release() {
+    for (auto &block : blocks) {
+        if (block) ::release(block);
+        block = nullptr;
+    }
+}
+
+EventArena::Hold::Hold(Hold &&other) noexcept {
+    for (std::size_t i = 0; i < 2; ++i) {
+        blocks[i] = other.blocks[i];
+        other.blocks[i] = nullptr;
+    }
+}
+
+EventArena::Hold &EventArena::Hold::operator=(Hold &&other) noexcept {
+    if (this == &other) return *this;
+    release();
+    for (std::size_t i = 0; i < 2; ++i) {
+        blocks[i] = other.blocks[i];
+        other.blocks[i] = nullptr;
+    }
+    return *this;
+}
+
+EventArena::Scope::Scope(Hold &hold) : outer(active), start(allocatedBytes) {
+    active = nullptr;
+    Block *&block = current.block;
+    if (!block || kBlockSize - block->used < kMinFree) {
+        if (Block *fresh = take()) {
+            if (block) ::release(block);
+            block = fresh;
+        }
+    }
+    if (!block) return;
+    for (auto &held : hold.blocks) {
+        if (held == block) {
+            active = block;
+            return;
+        }
+        if (!held) {
+            block->refs.fetch_add(1, std::memory_order_relaxed);
+            held = block;
+            active = block;
+            return;
+        }
+    }
+    // held by too many threads already: this part goes to the heap
+}
+
+EventArena::Scope::~Scope() {
+    active = outer;
+}
+
+std::size_t EventArena::Scope::allocated() const {
+    return allocatedBytes - start;
+}
+
+void *EventArena::allocate(std::size_t bytes, std::size_t align) {
+    allocatedBytes += bytes;
+    if (Block *block = active) {
+        std::size_t at = (block->used + align - 1) & ~(align - 1);
+        if (at + bytes <= kBlockSize) {
+            block->used = at + bytes;
+            return reinterpret_cast<char *>(block) + at;
+        }
+        region.spilled.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ::operator new(bytes);
+}
+
+void EventArena::deallocate(void *p) noexcept {
+    if (!region.owns(p)) ::operator delete(p);
+}
+
+namespace {
+bool inArena(const EventJson &value) {
+    switch (value.type()) {
+        case EventJson::value_t::object: {
+            const auto &object = value.get_ref<const EventJson::object_t &>();
+            if (!region.owns(&object)) return false;
+            for (const auto &member : object) {
+                if (!region.owns(&member) || !region.owns(member.first.data()) || !inArena(member.second)) return false;
+            }
+            return true;
+        }
+        case EventJson::value_t::array: {
+            const auto &array = value.get_ref<const EventJson::array_t &>();
+            if (!region.owns(&array) || (!array.empty() && !region.owns(array.data()))) return false;
+            for (const auto &element : array) {
+                if (!inArena(element)) return false;
+            }
+            return true;
+        }
+        case EventJson::value_t::string: {
+            const auto &text = value.get_ref<const EventString &>();
+            return region.owns(&text) && region.owns(text.data());
+        }
+        case EventJson::value_t::binary:
+            return false;
+        default:
+            return true;
+    }
+}
+} // namespace
+
+void discardJson(EventJson &value) noexcept {
+    if (!value.is_structured() || !inArena(value)) {
+        value = nullptr;
+        return;
+    }
+    // ends the old value's lifetime without running its destructor
+    ::new (static_cast<void *>(&value)) EventJson();
+}
+
+std::string EventArena::stats() {
+    if (region.begin == 0) return "unavailable";
+    std::lock_guard<std::mutex> lock(region.mtx);
+    std::ostringstream ss;
+    std::size_t used = region.carved - region.freeCount;
+    ss << "blocks=" << used << " free=" << region.freeCount << " memory_kb=" << used * kBlockSize / 1024
+       << " spilled=" << region.spilled.load(std::memory_order_relaxed);
+    return ss.str();
+}
@@ -0,0 +1,117 @@
+#include "EventClassifier.hpp"
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+constexpr std::string_view kNameKey = "_event_name\"";
+
+EventType typeFromPrefix(std::string_view prefix) {
+    // the first letter already tells the four keys apart
+    switch (prefix.empty() ? '\0' : prefix[0]) {
+        case 'f': return prefix == "flow" ? EventType::Flow : EventType::Unknown;
+        case 'p': return prefix == "packet" ? EventType::Packet : EventType::Unknown;
+        case 'd': return prefix == "daemon" ? EventType::Daemon : EventType::Unknown;
+        case 'e': return prefix == "error" ? EventType::Error : EventType::Unknown;
+        default: return EventType::Unknown;
+    }
+}
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+}
+
+std::uint32_t EventClassifier::hash(std::string_view s, std::uint32_t seed) {
+    // FNV-1a with a seed; names are short so hashing every byte is cheap
+    std::uint32_t h = 2166136261u ^ seed;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void EventClassifier::build(NameTable &table, const std::vector<std::string> &names) {
+    table.allowAll = names.empty();
+    if (table.allowAll) return;
+    std::size_t size = 2;
+    while (size < names.size() * 2) size <<= 1;
+    // search a seed that maps every configured name to its own slot
+    for (;; size <<= 1) {
+        for (std::uint32_t seed = 0; seed < 4096; ++seed) {
+            std::vector<std::string> slots(size);
+            bool ok = true;
+            for (const auto &n : names) {
+                auto &slot = slots[hash(n, seed) & (size - 1)];
+                if (!slot.empty() && slot != n) { ok = false; break; }
+                slot = n;
+            }
+            if (ok) {
+                table.seed = seed;
+                table.slots = std::move(slots);
+                return;
+            }
+        }
+        if (size > 1u << 16) throw std::runtime_error("cannot build event name table");
+    }
+}
+
+void EventClassifier::enable(EventType type, const EventConfig &cfg) {
+    auto &table = tables[static_cast<std::size_t>(type)];
+    table.enabled = true;
+    build(table, cfg.event_names);
+}
+
+bool EventClassifier::lookup(const NameTable &table, std::string_view name) const {
+    if (table.allowAll) return true;
+    return table.slots[hash(name, table.seed) & (table.slots.size() - 1)] == name;
+}
+
+bool EventClassifier::accepts(EventType type, std::string_view name) {
+    if (type == EventType::Unknown) return true;
+    auto i = static_cast<std::size_t>(type);
+    if (!tables[i].enabled) {
+        rejectedType[i].fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!lookup(tables[i], name)) {
+        rejectedName[i].fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+EventClassifier::Verdict EventClassifier::classify(std::string_view frame) {
+    Verdict v;
+    std::size_t pos = frame.find(kNameKey);
+    if (pos == std::string_view::npos) return v;
+
+    // walk back to the opening quote of the key
+    std::size_t keyStart = frame.rfind('"', pos);
+    if (keyStart == std::string_view::npos) return v;
+    v.type = typeFromPrefix(frame.substr(keyStart + 1, pos - keyStart - 1));
+    if (v.type == EventType::Unknown) return v;
+
+    std::size_t i = pos + kNameKey.size();
+    while (i < frame.size() && isSpace(frame[i])) ++i;
+    if (i >= frame.size() || frame[i] != ':') return Verdict{};
+    ++i;
+    while (i < frame.size() && isSpace(frame[i])) ++i;
+    if (i >= frame.size() || frame[i] != '"') return Verdict{};
+    std::size_t end = frame.find('"', ++i);
+    if (end == std::string_view::npos) return Verdict{};
+    std::string_view name = frame.substr(i, end - i);
+    if (name.find('\\') != std::string_view::npos) return Verdict{}; // escaped: let the parser decide
+
+    v.accept = accepts(v.type, name);
+    return v;
+}
+
+std::string EventClassifier::stats() const {
+    std::ostringstream ss;
+    for (std::size_t i = 0; i < kEventTypeCount; ++i) {
+        if (i) ss << ' ';
+        ss << eventTypeName(static_cast<EventType>(i))
+           << "{type=" << rejectedType[i].load(std::memory_order_relaxed)
+           << " name=" << rejectedName[i].load(std::memory_order_relaxed) << '}';
+    }
+    return ss.str();
+}
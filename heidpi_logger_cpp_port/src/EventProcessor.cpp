@@ -1,55 +1,254 @@
 #include "EventProcessor.hpp"
-#include <fstream>
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <ctime>
 #include <filesystem>
+#include <sstream>
+#include <vector>
 
 EventProcessor::EventProcessor(const EventConfig &cfg, const std::string &outDir)
-    : config(cfg), directory(outDir) {
+    : config(cfg), directory(outDir), projection(cfg.keep_fields, cfg.ignore_fields, cfg.ignore_risks) {
+    static std::atomic<std::uint64_t> nextId{1};
+    id = nextId.fetch_add(1);
     if (cfg.geoip_enabled && !cfg.geoip_path.empty()) {
-        geo = std::make_unique<GeoIP>(cfg.geoip_path, cfg.geoip_keys);
+        geo = std::make_shared<const GeoIP>(cfg);
+        if (cfg.geoip_reload) {
+            geoWatcher = std::make_unique<FileWatcher>(cfg.geoip_path, [this] { reloadGeo(); });
+        }
     } else {
         // optional, aber hilfreich zur Diagnose:
         Logger::info(std::string("GeoIP disabled for '") + cfg.filename +
                      "' (enabled=" + (cfg.geoip_enabled ? "true" : "false") +
                      ", path=" + (cfg.geoip_path.empty() ? "<empty>" : cfg.geoip_path) + ")");
     }
+    if (cfg.raw_output) {
+        raw = projection.empty();
+        if (!raw) Logger::info("raw_output ignored for '" + cfg.filename + "': ignore_fields/ignore_risks/keep_fields set");
+    }
+    if (cfg.rollup) rollup = std::make_unique<Rollup>(cfg, directory);
+    if (config.log_events || config.aggregate) {
+        auto path = std::filesystem::path(directory) / (config.filename + ".json");
+        sink = OutputSink::open(path.string(), config.flush);
+    }
+}
+
+EventProcessor::~EventProcessor() {
+    geoWatcher.reset(); // stop reloads before the members go away
+}
+
+void EventProcessor::reloadGeo() {
+    // opened here, on the watcher thread; workers keep running on the old one
+    std::shared_ptr<const GeoIP> fresh;
+    try {
+        fresh = std::make_shared<const GeoIP>(config);
+    } catch (const std::exception &e) {
+        Logger::error("GeoIP reload failed: " + config.geoip_path + " " + e.what());
+        return;
+    }
+    if (!fresh->ok()) {
+        Logger::error("GeoIP reload failed, keeping the current database: " + config.geoip_path);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(geoMtx);
+        geo.swap(fresh);
+    }
+    geoGeneration.fetch_add(1, std::memory_order_release);
+    Logger::info("GeoIP reloaded: " + config.geoip_path);
+    // `fresh` now holds the previous instance; it is closed once the last
+    // worker has moved on (its caches belonged to it and go with it)
+}
+
+namespace {
+// Read-mostly GeoIP snapshot per thread and processor.
+struct GeoSnapshot {
+    std::uint64_t owner;
+    std::uint64_t generation;
+    std::shared_ptr<const GeoIP> geo;
+};
+thread_local std::vector<GeoSnapshot> geoSnapshots;
+constexpr std::uint64_t kReleased = ~0ULL; // no generation, refetch on next use
+} // namespace
+
+const GeoIP *EventProcessor::currentGeo() {
+    // an unchanged generation costs one atomic load, no reference counting and no lock
+    auto generation = geoGeneration.load(std::memory_order_acquire);
+    for (auto &entry : geoSnapshots) {
+        if (entry.owner != id) continue;
+        if (entry.generation != generation) {
+            std::lock_guard<std::mutex> lock(geoMtx);
+            entry.geo = geo;
+            entry.generation = generation;
+        }
+        return entry.geo.get();
+    }
+    std::lock_guard<std::mutex> lock(geoMtx);
+    geoSnapshots.push_back({id, generation, geo});
+    return geoSnapshots.back().geo.get();
+}
+
+void EventProcessor::idle() {
+    // A parked worker must not keep a replaced database (mapping, caches,
+    // flat table) alive until its next event; it fetches it again then.
+    for (auto &entry : geoSnapshots) {
+        if (entry.owner != id || entry.generation == kReleased) continue;
+        entry.geo.reset();
+        entry.generation = kReleased;
+    }
 }
 
-static std::string nowTs() {
+// Valid until the next call on this thread.
+static std::string_view nowTs() {
     auto now = std::chrono::system_clock::now();
     std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm tm = *std::localtime(&tt);
-    char buf[64];
-    std::strftime(buf, sizeof(buf), "%FT%T", &tm);
-    return std::string(buf);
+    std::tm tm{};
+    localtime_r(&tt, &tm);
+    thread_local char buf[64];
+    return std::string_view(buf, std::strftime(buf, sizeof(buf), "%FT%T", &tm));
 }
 
-void EventProcessor::process(const nlohmann::json &j) {
-    nlohmann::json out = j;
-    out["timestamp"] = nowTs();
+// Pass-through: the frame is written as received with the added members
+// spliced in before its closing brace. Falls back to the DOM path if that
+// would duplicate a member.
+bool EventProcessor::processRaw(Event &event, const GeoIP *geo) {
+    const auto &fields = event.fields;
+    if (!fields.is_object() || fields.contains("timestamp")) return false;
+    if (geo && (fields.contains("src_geoip2_city") || fields.contains("dst_geoip2_city"))) return false;
 
-    if (geo) { // statt config.geoip_enabled
-        std::string src = j.value("src_ip", "");
-        std::string dst = j.value("dst_ip", "");
-        geo->enrich(src, dst, out);
+    EventString &line = event.raw;
+    auto isSpace = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+    std::size_t end = line.size();
+    while (end > 0 && isSpace(line[end - 1])) --end;
+    if (end < 2 || line[end - 1] != '}') return false;
+    std::size_t last = end - 1;
+    while (last > 0 && isSpace(line[last - 1])) --last;
+    bool empty = last > 0 && line[last - 1] == '{';
+    line.resize(end - 1);
+
+    line += empty ? "\"timestamp\":\"" : ",\"timestamp\":\"";
+    line += nowTs();
+    line += '"';
+    if (geo) {
+        geo->enrichRaw(fields.value("src_ip", ""), fields.value("dst_ip", ""), line);
+    }
+    line += '}';
+    if (sink) sink->write(line);
+    return true;
+}
+
+std::string EventProcessor::stats() const {
+    std::shared_ptr<const GeoIP> current;
+    {
+        std::lock_guard<std::mutex> lock(geoMtx);
+        current = geo;
     }
-    for (const auto &field : config.ignore_fields) {
-        out.erase(field);
+    if (!current) return std::string();
+    return "reloads=" + std::to_string(geoGeneration.load(std::memory_order_relaxed)) + ' ' +
+           current->stats();
+}
+
+FlowAggregator &EventProcessor::localAggregator() {
+    thread_local std::vector<std::pair<std::uint64_t, FlowAggregator *>> local;
+    for (auto &entry : local) {
+        if (entry.first == id) return *entry.second;
     }
-    if (!config.ignore_risks.empty() && out.contains("ndpi") && out["ndpi"].contains("flow_risk")) {
-        for (const auto &risk : config.ignore_risks) {
-            out["ndpi"]["flow_risk"].erase(risk);
+    // the cap is shared by the worker threads
+    std::size_t maxBytes = (config.aggregate_max_mb << 20) / static_cast<std::size_t>(std::max(1, config.threads));
+    auto aggregator = std::make_unique<FlowAggregator>(maxBytes, [this](EventJson &record) {
+        write(record, currentGeo());
+    });
+    std::lock_guard<std::mutex> lock(aggregatorsMtx);
+    aggregators.push_back(std::move(aggregator));
+    local.emplace_back(id, aggregators.back().get());
+    return *aggregators.back();
+}
+
+void EventProcessor::finish() {
+    {
+        std::lock_guard<std::mutex> lock(aggregatorsMtx);
+        for (auto &aggregator : aggregators) aggregator->flush();
+    }
+    if (rollup) rollup->finish();
+}
+
+std::string EventProcessor::rollupStats() const {
+    return rollup ? rollup->stats() : std::string();
+}
+
+std::string EventProcessor::aggregateStats() const {
+    if (!config.aggregate) return std::string();
+    std::size_t flows = 0, memory = 0;
+    std::uint64_t records = 0, evicted = 0;
+    {
+        std::lock_guard<std::mutex> lock(aggregatorsMtx);
+        for (const auto &aggregator : aggregators) {
+            flows += aggregator->flows();
+            memory += aggregator->memory();
+            records += aggregator->records();
+            evicted += aggregator->evictions();
         }
     }
-    std::filesystem::create_directories(directory);
-    auto path = std::filesystem::path(directory) / (config.filename + ".json");
-    std::ofstream ofs(path, std::ios::app);
-    if (!ofs.is_open()) {
-        Logger::error("Failed to open output file: " + path.string());
-        return;
+    std::ostringstream ss;
+    ss << "flows=" << flows << " memory_kb=" << memory / 1024 << " records=" << records
+       << " evicted=" << evicted;
+    return ss.str();
+}
+
+void EventProcessor::process(Event &event) {
+    // whatever is built from here on goes to the event's arena blocks
+    EventArena::Scope scope(event.arena);
+    const GeoIP *geo = currentGeo();
+    bool logged = config.log_events && (!config.aggregate || config.aggregate_keep_events);
+    // Rollups read GeoIP group values from the event once write() has
+    // enriched it; otherwise (raw path, nothing logged) they look them up
+    // themselves and need the whole document even where raw would skip it.
+    bool rollupAfterWrite = rollup && logged && !raw;
+    if (rollup && !rollupAfterWrite) {
+        try {
+            rollup->add(event.dom(), geo);
+        } catch (...) {
+            return; // JSON‑Fehler ignorieren
+        }
+    }
+    if (config.aggregate) {
+        try {
+            localAggregator().add(event.dom());
+        } catch (...) {
+            return; // JSON‑Fehler ignorieren
+        }
+    }
+    if (!logged) return;
+    if (raw && processRaw(event, geo)) return;
+    try {
+        event.dom();
+    } catch (...) {
+        return; // JSON‑Fehler ignorieren
+    }
+    // the event ends here, so its document is written in place
+    write(event.fields, geo);
+    if (rollupAfterWrite) {
+        try {
+            rollup->add(event.fields, nullptr);
+        } catch (...) {
+            return; // JSON‑Fehler ignorieren
+        }
+    }
+}
+
+void EventProcessor::write(EventJson &out, const GeoIP *geo) {
+    out["timestamp"] = nowTs();
+
+    if (geo) { // statt config.geoip_enabled
+        EventString src = out.value("src_ip", "");
+        EventString dst = out.value("dst_ip", "");
+        geo->enrich(src, dst, out);
     }
-    ofs << out.dump() << std::endl;
+    if (!sink) return;
+    // ignore_fields/ignore_risks/keep_fields are applied while serializing
+    thread_local std::string line;
+    line.clear();
+    projection.serialize(out, line);
+    sink->write(line);
 }
 
@@ -0,0 +1,29 @@
+#include "EventType.hpp"
+
+const char *eventNameKey(EventType type) {
+    switch (type) {
+        case EventType::Flow: return "flow_event_name";
+        case EventType::Packet: return "packet_event_name";
+        case EventType::Daemon: return "daemon_event_name";
+        case EventType::Error: return "error_event_name";
+        default: return "";
+    }
+}
+
+const char *eventTypeName(EventType type) {
+    switch (type) {
+        case EventType::Flow: return "flow";
+        case EventType::Packet: return "packet";
+        case EventType::Daemon: return "daemon";
+        case EventType::Error: return "error";
+        default: return "unknown";
+    }
+}
+
+EventType classifyEvent(const EventJson &event) {
+    if (event.contains("flow_event_name")) return EventType::Flow;
+    if (event.contains("packet_event_name")) return EventType::Packet;
+    if (event.contains("daemon_event_name")) return EventType::Daemon;
+    if (event.contains("error_event_name")) return EventType::Error;
+    return EventType::Unknown;
+}
@@ -0,0 +1,153 @@
+#include "FieldExtractor.hpp"
+#include "Logger.hpp"
+
+#ifdef HEIDPI_HAVE_SIMDJSON
+#include <simdjson.h>
+static_assert(kParsePadding >= simdjson::SIMDJSON_PADDING, "kParsePadding too small for simdjson");
+#endif
+
+void FieldSet::add(const std::vector<std::string> &path) {
+    Node *node = &root;
+    for (const auto &segment : path) {
+        if (node->whole) return; // a parent is already taken completely
+        node = &node->children[segment];
+    }
+    node->whole = true;
+    node->children.clear();
+}
+
+namespace {
+
+class DomExtractor : public FieldExtractor {
+public:
+    bool extract(Event &event) override {
+        try {
+            event.fields = EventJson::parse(event.raw);
+        } catch (...) {
+            return false;
+        }
+        event.complete = true;
+        return true;
+    }
+};
+
+#ifdef HEIDPI_HAVE_SIMDJSON
+namespace od = simdjson::ondemand;
+
+class SimdjsonExtractor : public FieldExtractor {
+public:
+    explicit SimdjsonExtractor(const FieldSet &f) : fields(f) {}
+
+    bool extract(Event &event) override {
+        if (event.raw.capacity() < event.raw.size() + simdjson::SIMDJSON_PADDING) {
+            event.raw.reserve(event.raw.size() + simdjson::SIMDJSON_PADDING);
+        }
+        if (fields.root.whole) {
+            // e.g. a filter on json_dict itself: nothing to skip
+            DomExtractor dom;
+            return dom.extract(event);
+        }
+        try {
+            od::document doc = parser.iterate(event.raw.data(), event.raw.size(), event.raw.capacity());
+            event.fields = EventJson::object();
+            od::object obj = doc.get_object();
+            select(obj, fields.root, event.fields);
+        } catch (const simdjson::simdjson_error &) {
+            return false;
+        }
+        event.complete = false;
+        event.parseDom = &parseDom;
+        return true;
+    }
+
+private:
+    // Event::dom() on a worker: the whole document, walked with the
+    // thread's own parser so it costs no heap allocation either.
+    static void parseDom(Event &event) {
+        thread_local od::parser parser;
+        od::document doc = parser.iterate(event.raw.data(), event.raw.size(), event.raw.capacity());
+        od::json_type type = doc.type();
+        if (type != od::json_type::object && type != od::json_type::array) {
+            // scalar documents are not values in simdjson
+            EventJson parsed = EventJson::parse(event.raw);
+            discardJson(event.fields);
+            event.fields = std::move(parsed);
+            return;
+        }
+        EventJson parsed = toJson(doc.get_value());
+        if (!doc.at_end()) throw simdjson::simdjson_error(simdjson::TRAILING_CONTENT);
+        discardJson(event.fields);
+        event.fields = std::move(parsed);
+    }
+
+    static void select(od::object obj, const FieldSet::Node &node, EventJson &out) {
+        std::size_t found = 0;
+        for (auto field : obj) {
+            std::string_view key = field.unescaped_key();
+            auto it = node.children.find(key);
+            if (it == node.children.end()) continue;
+            od::value value = field.value();
+            if (it->second.whole) {
+                out[key] = toJson(value);
+            } else if (value.type() == od::json_type::object) {
+                auto &sub = out[key];
+                sub = EventJson::object();
+                select(value.get_object(), it->second, sub);
+            }
+            if (++found == node.children.size()) break;
+        }
+    }
+
+    static EventJson toJson(od::value value) {
+        switch (value.type()) {
+            case od::json_type::object: {
+                EventJson obj = EventJson::object();
+                for (auto field : value.get_object()) {
+                    std::string_view key = field.unescaped_key();
+                    obj[key] = toJson(field.value());
+                }
+                return obj;
+            }
+            case od::json_type::array: {
+                EventJson arr = EventJson::array();
+                for (auto item : value.get_array()) arr.push_back(toJson(item.value()));
+                return arr;
+            }
+            case od::json_type::number:
+                switch (value.get_number_type()) {
+                    case od::number_type::signed_integer: {
+                        // nlohmann stores non-negative integers as unsigned; stay compatible
+                        std::int64_t v = value.get_int64();
+                        if (v >= 0) return static_cast<std::uint64_t>(v);
+                        return v;
+                    }
+                    case od::number_type::unsigned_integer: return static_cast<std::uint64_t>(value.get_uint64());
+                    default: return static_cast<double>(value.get_double());
+                }
+            case od::json_type::string:
+                return EventString(std::string_view(value.get_string()));
+            case od::json_type::boolean:
+                return static_cast<bool>(value.get_bool());
+            default:
+                return nullptr;
+        }
+    }
+
+    const FieldSet fields;
+    od::parser parser;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<FieldExtractor> FieldExtractor::create(ParseEngine engine, const FieldSet &fields) {
+    if (engine == ParseEngine::Simdjson) {
+#ifdef HEIDPI_HAVE_SIMDJSON
+        return std::make_unique<SimdjsonExtractor>(fields);
+#else
+        Logger::error("parser 'simdjson' requested but not built (HEIDPI_WITH_SIMDJSON=OFF), using nlohmann");
+#endif
+    }
+    (void)fields;
+    return std::make_unique<DomExtractor>();
+}
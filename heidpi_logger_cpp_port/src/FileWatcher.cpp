@@ -0,0 +1,89 @@
+#include "FileWatcher.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher(const std::string &path, std::function<void()> callback,
+                         std::chrono::milliseconds delay)
+    : onChange(std::move(callback)), settle(delay) {
+    std::filesystem::path file(path);
+    name = file.filename().string();
+    std::string dir = file.has_parent_path() ? file.parent_path().string() : ".";
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        Logger::error("inotify_init failed for " + path + ": " + std::strerror(errno));
+        return;
+    }
+    if (inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        Logger::error("Cannot watch " + dir + ": " + std::strerror(errno));
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        return;
+    }
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd < 0) {
+        Logger::error(std::string("eventfd failed: ") + std::strerror(errno));
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        return;
+    }
+    thread = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+    if (thread.joinable()) {
+        std::uint64_t one = 1;
+        ssize_t n = ::write(stopFd, &one, sizeof(one));
+        (void)n;
+        thread.join();
+    }
+    if (stopFd >= 0) ::close(stopFd);
+    if (inotifyFd >= 0) ::close(inotifyFd);
+}
+
+void FileWatcher::run() {
+    using Clock = std::chrono::steady_clock;
+    alignas(inotify_event) char buf[4096];
+    bool pending = false;
+    Clock::time_point due;
+    for (;;) {
+        int timeout = -1;
+        if (pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now());
+            timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, left.count()));
+        }
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        int ready = ::poll(fds, 2, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            Logger::error(std::string("poll failed in file watcher: ") + std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents) return;
+        if (fds[0].revents) {
+            ssize_t len;
+            while ((len = ::read(inotifyFd, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len;) {
+                    auto *ev = reinterpret_cast<inotify_event *>(p);
+                    if (ev->len > 0 && name == ev->name) {
+                        pending = true;
+                        due = Clock::now() + settle;
+                    }
+                    p += sizeof(inotify_event) + ev->len;
+                }
+            }
+        }
+        if (pending && Clock::now() >= due) {
+            pending = false;
+            onChange();
+        }
+    }
+}
@@ -0,0 +1,284 @@
+#include "FilterExpr.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+class FilterExpr::Parser {
+public:
+    Parser(const std::string &t, std::vector<Node> &n) : text(t), nodes(n) {}
+
+    int parse() {
+        int root = parseOr();
+        skipSpace();
+        if (pos != text.size()) fail("unexpected input");
+        return root;
+    }
+
+private:
+    const std::string &text;
+    std::vector<Node> &nodes;
+    std::size_t pos{0};
+
+    [[noreturn]] void fail(const std::string &what) const {
+        throw std::runtime_error("filter: " + what + " at offset " + std::to_string(pos) + " in '" + text + "'");
+    }
+
+    void skipSpace() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) ++pos;
+    }
+
+    static bool isNameChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+    }
+
+    // Consumes `tok` if it comes next; words must not run into a name.
+    bool accept(const char *tok) {
+        skipSpace();
+        std::size_t len = std::char_traits<char>::length(tok);
+        if (text.compare(pos, len, tok) != 0) return false;
+        if (std::isalpha(static_cast<unsigned char>(tok[0])) && pos + len < text.size() &&
+            isNameChar(text[pos + len]))
+            return false;
+        pos += len;
+        return true;
+    }
+
+    int add(Node node) {
+        nodes.push_back(std::move(node));
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    int binary(Kind kind, int lhs, int rhs, Op op = Op::Eq) {
+        Node n;
+        n.kind = kind;
+        n.op = op;
+        n.lhs = lhs;
+        n.rhs = rhs;
+        return add(std::move(n));
+    }
+
+    int parseOr() {
+        int lhs = parseAnd();
+        while (accept("or") || accept("||")) lhs = binary(Kind::Or, lhs, parseAnd());
+        return lhs;
+    }
+
+    int parseAnd() {
+        int lhs = parseNot();
+        while (accept("and") || accept("&&")) lhs = binary(Kind::And, lhs, parseNot());
+        return lhs;
+    }
+
+    int parseNot() {
+        if (accept("not") || (peekBang() && accept("!"))) return binary(Kind::Not, parseNot(), -1);
+        return parseCompare();
+    }
+
+    bool peekBang() {
+        skipSpace();
+        return pos + 1 < text.size() ? text[pos] == '!' && text[pos + 1] != '=' : pos < text.size() && text[pos] == '!';
+    }
+
+    int parseCompare() {
+        int lhs = parsePrimary();
+        static const struct { const char *tok; Op op; } ops[] = {
+            {"==", Op::Eq}, {"!=", Op::Ne}, {"<=", Op::Le}, {">=", Op::Ge}, {"<", Op::Lt}, {">", Op::Gt}};
+        for (const auto &o : ops) {
+            if (accept(o.tok)) return binary(Kind::Compare, lhs, parsePrimary(), o.op);
+        }
+        std::size_t save = pos;
+        if (accept("not")) {
+            if (accept("in")) return binary(Kind::Not, binary(Kind::In, lhs, parsePrimary()), -1);
+            pos = save;
+        }
+        if (accept("in")) return binary(Kind::In, lhs, parsePrimary());
+        return lhs;
+    }
+
+    int parsePrimary() {
+        skipSpace();
+        if (accept("(")) {
+            int inner = parseOr();
+            if (!accept(")")) fail("expected ')'");
+            return inner;
+        }
+        if (pos < text.size() && (text[pos] == '[' || text[pos] == '\'' || text[pos] == '"' ||
+                                  text[pos] == '-' || std::isdigit(static_cast<unsigned char>(text[pos])))) {
+            return literal(parseLiteral());
+        }
+        if (accept("true")) return literal(true);
+        if (accept("false")) return literal(false);
+        if (accept("null")) return literal(nullptr);
+
+        Node n;
+        n.kind = Kind::Path;
+        std::string first = parseName();
+        // json_dict is the whole event, as in the Python logger's filters
+        if (first != "json_dict") n.path.push_back(std::move(first));
+        while (true) {
+            if (accept(".")) {
+                n.path.push_back(parseName());
+            } else if (accept("[")) {
+                skipSpace();
+                if (pos >= text.size() || (text[pos] != '\'' && text[pos] != '"')) fail("expected quoted member name");
+                EventJson key = parseLiteral();
+                const auto &name = key.get_ref<const EventString &>();
+                n.path.emplace_back(name.data(), name.size());
+                if (!accept("]")) fail("expected ']'");
+            } else {
+                break;
+            }
+        }
+        return add(std::move(n));
+    }
+
+    std::string parseName() {
+        skipSpace();
+        std::size_t start = pos;
+        while (pos < text.size() && isNameChar(text[pos])) ++pos;
+        if (start == pos) fail("expected field name");
+        return text.substr(start, pos - start);
+    }
+
+    int literal(EventJson value) {
+        Node n;
+        n.kind = Kind::Literal;
+        n.literal = std::move(value);
+        return add(std::move(n));
+    }
+
+    EventJson parseLiteral() {
+        skipSpace();
+        if (pos >= text.size()) fail("expected value");
+        char c = text[pos];
+        if (c == '[') {
+            ++pos;
+            EventJson list = EventJson::array();
+            if (accept("]")) return list;
+            do {
+                list.push_back(parseLiteral());
+            } while (accept(","));
+            if (!accept("]")) fail("expected ']'");
+            return list;
+        }
+        if (c == '\'' || c == '"') {
+            std::size_t end = text.find(c, pos + 1);
+            if (end == std::string::npos) fail("unterminated string");
+            EventString s(text, pos + 1, end - pos - 1);
+            pos = end + 1;
+            return s;
+        }
+        if (accept("true")) return true;
+        if (accept("false")) return false;
+        if (accept("null")) return nullptr;
+        const char *begin = text.c_str() + pos;
+        char *end = nullptr;
+        std::size_t numEnd = std::min(text.find_first_not_of("+-0123456789.eE", pos), text.size());
+        if (text.find_first_of(".eE", pos) < numEnd) {
+            double d = std::strtod(begin, &end);
+            if (end == begin) fail("expected number");
+            pos += static_cast<std::size_t>(end - begin);
+            return d;
+        }
+        long long v = std::strtoll(begin, &end, 10);
+        if (end == begin) fail("expected number");
+        pos += static_cast<std::size_t>(end - begin);
+        return v;
+    }
+};
+
+FilterExpr FilterExpr::compile(const std::string &text) {
+    FilterExpr f;
+    if (text.find_first_not_of(" \t\r\n") == std::string::npos) return f; // no filter
+    Parser parser(text, f.nodes);
+    f.root = parser.parse();
+    return f;
+}
+
+const EventJson *FilterExpr::operand(int index, const EventJson &event) const {
+    const Node &n = nodes[static_cast<std::size_t>(index)];
+    if (n.kind == Kind::Literal) return &n.literal;
+    if (n.kind != Kind::Path) return nullptr;
+    const EventJson *cur = &event;
+    for (const auto &segment : n.path) {
+        if (!cur->is_object()) return nullptr;
+        auto it = cur->find(std::string_view(segment));
+        if (it == cur->end()) return nullptr;
+        cur = &*it;
+    }
+    return cur;
+}
+
+template <typename T>
+bool FilterExpr::compare(const T &a, const T &b, Op op) {
+    switch (op) {
+        case Op::Eq: return a == b;
+        case Op::Ne: return a != b;
+        case Op::Lt: return a < b;
+        case Op::Le: return a <= b;
+        case Op::Gt: return a > b;
+        case Op::Ge: return a >= b;
+    }
+    return false;
+}
+
+bool FilterExpr::eval(int index, const EventJson &event) const {
+    const Node &n = nodes[static_cast<std::size_t>(index)];
+    switch (n.kind) {
+        case Kind::Or: return eval(n.lhs, event) || eval(n.rhs, event);
+        case Kind::And: return eval(n.lhs, event) && eval(n.rhs, event);
+        case Kind::Not: return !eval(n.lhs, event);
+        case Kind::Path: return operand(index, event) != nullptr;
+        case Kind::Literal:
+            return !(n.literal.is_null() || n.literal == false || n.literal == 0 || n.literal == "");
+        case Kind::Compare: {
+            const EventJson *a = operand(n.lhs, event);
+            const EventJson *b = operand(n.rhs, event);
+            if (!a || !b) return false;
+            Op op = n.op;
+            if (a->is_number() && b->is_number()) {
+                if (a->is_number_float() || b->is_number_float())
+                    return compare(a->get<double>(), b->get<double>(), op);
+                if (a->is_number_unsigned() && b->is_number_unsigned())
+                    return compare(a->get<std::uint64_t>(), b->get<std::uint64_t>(), op);
+                return compare(a->get<double>(), b->get<double>(), op);
+            }
+            if (a->is_string() && b->is_string())
+                return compare(a->get_ref<const EventString &>(), b->get_ref<const EventString &>(), op);
+            if (n.op == Op::Eq) return *a == *b;
+            if (n.op == Op::Ne) return *a != *b;
+            return false;
+        }
+        case Kind::In: {
+            const EventJson *a = operand(n.lhs, event);
+            const EventJson *b = operand(n.rhs, event);
+            if (!a || !b) return false;
+            if (b->is_array()) {
+                for (const auto &item : *b) {
+                    if (item == *a) return true;
+                    if (item.is_number() && a->is_number() && item.get<double>() == a->get<double>()) return true;
+                }
+                return false;
+            }
+            if (!a->is_string()) return false;
+            if (b->is_object()) return b->contains(a->get_ref<const EventString &>());
+            if (b->is_string())
+                return b->get_ref<const EventString &>().find(a->get_ref<const EventString &>()) != EventString::npos;
+            return false;
+        }
+    }
+    return false;
+}
+
+bool FilterExpr::matches(const EventJson &event) const {
+    return root < 0 || eval(root, event);
+}
+
+std::vector<std::vector<std::string>> FilterExpr::paths() const {
+    std::vector<std::vector<std::string>> result;
+    for (const auto &n : nodes) {
+        if (n.kind == Kind::Path) result.push_back(n.path);
+    }
+    return result;
+}
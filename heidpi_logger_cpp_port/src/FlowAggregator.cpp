@@ -0,0 +1,125 @@
+#include "FlowAggregator.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+// per flow besides the strings: State plus FlowManager record and index share
+constexpr std::size_t kFlowBytes = 192;
+
+std::size_t stringHeap(const std::string &s) {
+    // SSO strings live inside State
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+} // namespace
+
+FlowAggregator::FlowAggregator(std::size_t limit, Emit callback)
+    : maxBytes(limit), emit(std::move(callback)),
+      manager([this](const FlowManager::Instance &instance, const FlowManager::Flow &flow,
+                     FlowManager::CleanupReason reason) { finish(instance, flow, reason); }) {}
+
+std::size_t FlowAggregator::heapBytes(const State &s) {
+    return stringHeap(s.srcIp) + stringHeap(s.dstIp) + stringHeap(s.ndpi);
+}
+
+void FlowAggregator::account(std::size_t before, std::size_t after) {
+    bytes.store(bytes.load(std::memory_order_relaxed) + after - before, std::memory_order_relaxed);
+}
+
+void FlowAggregator::add(const EventJson &event) {
+    FlowEventRecord record;
+    // numeric l4_proto values have no enum and end up in the overflow
+    record.parse(event, true);
+    current = &record;
+    std::uint32_t slot = manager.update(record);
+    current = nullptr;
+    if (slot == FlowManager::kNoFlow) return;
+    if (slot >= states.size()) states.resize(slot + 1);
+    merge(states[slot], record);
+    while (maxBytes > 0 && memory() > maxBytes && manager.evict()) {}
+}
+
+void FlowAggregator::flush() {
+    manager.shutdown();
+}
+
+void FlowAggregator::merge(State &s, const FlowEventRecord &event) {
+    std::size_t before = heapBytes(s);
+    bool fresh = s.events == 0;
+    if (fresh) {
+        s.srcIp = event.src_ip;
+        s.dstIp = event.dst_ip;
+        s.l3Proto = event.l3_proto;
+        s.l4Proto = event.l4_proto;
+        if (s.l4Proto == L4Proto::Other) {
+            for (const auto &member : event.overflow) {
+                if (member.first != "l4_proto") continue;
+                std::uint64_t number = 0;
+                if (member.second->is_number_unsigned()) number = member.second->get<std::uint64_t>();
+                else if (member.second->is_number_integer() && member.second->get<std::int64_t>() >= 0)
+                    number = static_cast<std::uint64_t>(member.second->get<std::int64_t>());
+                else break;
+                if (number <= 255) s.l4Number = static_cast<std::int16_t>(number);
+                break;
+            }
+        }
+        s.srcPort = static_cast<std::uint16_t>(event.src_port);
+        s.dstPort = static_cast<std::uint16_t>(event.dst_port);
+        s.firstSeen = event.flow_first_seen;
+    }
+    ++s.events;
+    // nDPId's counters are running totals
+    s.srcPackets = std::max(s.srcPackets, event.flow_src_packets_processed);
+    s.dstPackets = std::max(s.dstPackets, event.flow_dst_packets_processed);
+    s.srcBytes = std::max(s.srcBytes, event.flow_src_tot_l4_payload_len);
+    s.dstBytes = std::max(s.dstBytes, event.flow_dst_tot_l4_payload_len);
+
+    if (event.ndpi) {
+        // detections and the final event carry the verdict; plain updates
+        // only fill in a flow that has none yet
+        if (s.ndpi.empty() || event.flow_event_name != FlowEventName::Update) s.ndpi = event.ndpi->dump();
+    }
+    account(before, heapBytes(s) + (fresh ? kFlowBytes : 0));
+}
+
+void FlowAggregator::finish(const FlowManager::Instance &instance, const FlowManager::Flow &flow,
+                            FlowManager::CleanupReason reason) {
+    if (flow.slot >= states.size()) states.resize(flow.slot + 1);
+    State &s = states[flow.slot];
+    using Reason = FlowManager::CleanupReason;
+    // end/idle come with the event being added, which belongs to this flow
+    if (current && (reason == Reason::FlowEnd || reason == Reason::FlowIdle)) merge(s, *current);
+
+    if (s.events > 0) {
+        EventJson record;
+        record["alias"] = instance.alias;
+        record["source"] = instance.source;
+        record["thread_id"] = flow.threadId;
+        record["flow_id"] = flow.flowId;
+        record["flow_event_name"] = "aggregate";
+        record["cleanup_reason"] = FlowManager::reasonName(reason);
+        if (reason == Reason::Evicted) record["partial"] = true;
+        if (!s.srcIp.empty()) record["src_ip"] = s.srcIp;
+        if (!s.dstIp.empty()) record["dst_ip"] = s.dstIp;
+        if (s.srcPort) record["src_port"] = s.srcPort;
+        if (s.dstPort) record["dst_port"] = s.dstPort;
+        if (s.l3Proto != L3Proto::Other) record["l3_proto"] = enumName(s.l3Proto);
+        if (s.l4Proto != L4Proto::Other) record["l4_proto"] = enumName(s.l4Proto);
+        else if (s.l4Number >= 0) record["l4_proto"] = s.l4Number;
+        record["flow_first_seen"] = s.firstSeen;
+        record["flow_last_seen"] = flow.lastSeen;
+        record["flow_idle_time"] = flow.idleTime;
+        record["flow_src_packets_processed"] = s.srcPackets;
+        record["flow_dst_packets_processed"] = s.dstPackets;
+        record["flow_src_tot_l4_payload_len"] = s.srcBytes;
+        record["flow_dst_tot_l4_payload_len"] = s.dstBytes;
+        record["events"] = s.events;
+        if (!s.ndpi.empty()) record["ndpi"] = EventJson::parse(s.ndpi, nullptr, false);
+        if (emit) emit(record);
+        emitted.store(emitted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (reason == Reason::Evicted) evicted.store(evicted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        account(heapBytes(s) + kFlowBytes, 0);
+    }
+    // assigning State() would keep the string buffers
+    State released;
+    std::swap(s, released);
+}
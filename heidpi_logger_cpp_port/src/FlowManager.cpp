@@ -0,0 +1,478 @@
+#include "FlowManager.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+constexpr std::uint32_t kNil = 0xffffffff;
+constexpr std::uint16_t kNoBucket = 0xffff;
+// wheel tick: 1024 us; nDPId idle timeouts are seconds to hours
+constexpr unsigned kTickShift = 10;
+constexpr unsigned kLevels = 5;  // 64^5 ticks, about 13 days
+constexpr unsigned kSlotBits = 6;
+constexpr unsigned kSlots = 1U << kSlotBits;
+// clock jumps longer than this re-sort the wheel instead of stepping it
+constexpr std::uint64_t kMaxStep = 1ULL << 18;
+
+// bits a..b (inclusive) of a 64-bit occupancy word
+std::uint64_t bitRange(unsigned a, unsigned b) {
+    return (~0ULL >> (63 - b)) & (~0ULL << a);
+}
+
+template <typename T>
+void bump(std::atomic<T> &counter, long delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+} // namespace
+
+struct FlowManager::Record {
+    Flow flow;
+    std::uint64_t due{0}; // tick at which the flow has timed out
+    Wheel *wheel{nullptr};
+    std::uint32_t prev{kNil};
+    std::uint32_t next{kNil};
+    std::uint16_t bucket{kNoBucket}; // level * kSlots + slot
+    bool used{false};
+};
+
+// Slot lists of one clock. Level l slot i holds the flows due in the
+// 64^l-tick block with index i (mod 64) at most 63 blocks ahead of `now`,
+// so a list is due or cascaded exactly when `now` enters its block.
+struct FlowManager::Wheel {
+    std::uint64_t now{0}; // tick of the most recent thread_ts_usec
+    std::size_t count{0};
+    std::uint64_t occupied[kLevels]{};
+    std::uint32_t heads[kLevels][kSlots];
+
+    Wheel() { std::fill(&heads[0][0], &heads[0][0] + kLevels * kSlots, kNil); }
+};
+
+FlowManager::FlowManager(CleanupCallback callback, std::size_t expectedFlows)
+    : onCleanup(std::move(callback)) {
+    std::size_t size = 16;
+    while (size < 2 * expectedFlows) size <<= 1;
+    index.assign(size, Bucket{0, 0});
+    mask = size - 1;
+    slab.reserve(expectedFlows);
+}
+
+FlowManager::~FlowManager() = default;
+
+const char *FlowManager::reasonName(CleanupReason reason) {
+    switch (reason) {
+        case CleanupReason::DaemonInit: return "daemon_init";
+        case CleanupReason::DaemonShutdown: return "daemon_shutdown";
+        case CleanupReason::FlowEnd: return "end";
+        case CleanupReason::FlowIdle: return "idle";
+        case CleanupReason::FlowTimeout: return "timeout";
+        case CleanupReason::AppShutdown: return "app_shutdown";
+        case CleanupReason::Evicted: return "evicted";
+        default: return "invalid";
+    }
+}
+
+std::uint32_t FlowManager::instanceOf(std::string_view alias, std::string_view source) {
+    // nearly every event comes from the same instance as the one before
+    if (lastInstance != kNil && instances[lastInstance].alias == alias &&
+        instances[lastInstance].source == source) {
+        return lastInstance;
+    }
+    std::string key(alias);
+    key.push_back('\0');
+    key += source;
+    auto it = instanceIds.find(key);
+    if (it == instanceIds.end()) {
+        instances.push_back({std::string(alias), std::string(source)});
+        it = instanceIds.emplace(std::move(key), static_cast<std::uint32_t>(instances.size() - 1)).first;
+    }
+    lastInstance = it->second;
+    return lastInstance;
+}
+
+FlowManager::Wheel &FlowManager::wheelOf(std::uint32_t instance, std::uint32_t threadId) {
+    std::uint64_t key = static_cast<std::uint64_t>(instance) << 32 | threadId;
+    if (key == lastWheelKey) return *lastWheel;
+    auto &wheel = wheels[key];
+    if (!wheel) wheel = std::make_unique<Wheel>();
+    lastWheelKey = key;
+    lastWheel = wheel.get();
+    return *wheel;
+}
+
+// What update() takes from an event, whatever its type.
+struct FlowManager::Input {
+    std::string_view alias;
+    std::string_view source;
+    std::uint32_t threadId{0};
+    std::uint64_t threadTs{0}; // 0: no clock
+    CleanupReason daemon{CleanupReason::Invalid}; // DaemonInit/DaemonShutdown
+    bool flow{false};
+    std::uint64_t flowId{0};
+    std::uint64_t lastSeen{0};
+    std::uint64_t idleTime{0};
+    bool hasIdleTime{false};
+    CleanupReason flowEvent{CleanupReason::Invalid}; // FlowEnd/FlowIdle
+};
+
+std::uint32_t FlowManager::update(const FlowEventRecord &event) {
+    using F = FlowEventRecord::Field;
+    if (!event.has(F::alias) || !event.has(F::source)) return kNoFlow;
+    Input in;
+    in.alias = event.alias;
+    in.source = event.source;
+    in.threadId = static_cast<std::uint32_t>(event.thread_id);
+    in.threadTs = event.thread_ts_usec;
+    in.flow = event.has(F::flow_id);
+    in.flowId = event.flow_id;
+    in.lastSeen = std::max(event.flow_src_last_pkt_time, event.flow_dst_last_pkt_time);
+    in.idleTime = event.flow_idle_time;
+    in.hasIdleTime = event.has(F::flow_idle_time);
+    if (event.flow_event_name == FlowEventName::End) in.flowEvent = CleanupReason::FlowEnd;
+    else if (event.flow_event_name == FlowEventName::Idle) in.flowEvent = CleanupReason::FlowIdle;
+    return apply(in);
+}
+
+std::uint32_t FlowManager::update(const PacketEventRecord &event) {
+    using F = PacketEventRecord::Field;
+    if (!event.has(F::alias) || !event.has(F::source)) return kNoFlow;
+    Input in;
+    in.alias = event.alias;
+    in.source = event.source;
+    in.threadId = static_cast<std::uint32_t>(std::max<std::int64_t>(event.thread_id, 0));
+    in.threadTs = event.thread_ts_usec;
+    in.flow = event.has(F::flow_id); // packet-flow events
+    in.flowId = event.flow_id;
+    in.lastSeen = std::max(event.flow_src_last_pkt_time, event.flow_dst_last_pkt_time);
+    in.idleTime = event.flow_idle_time;
+    in.hasIdleTime = event.has(F::flow_idle_time);
+    return apply(in);
+}
+
+std::uint32_t FlowManager::update(const DaemonEventRecord &event) {
+    using F = DaemonEventRecord::Field;
+    if (!event.has(F::alias) || !event.has(F::source)) return kNoFlow;
+    Input in;
+    in.alias = event.alias;
+    in.source = event.source;
+    in.threadId = static_cast<std::uint32_t>(event.thread_id);
+    if (event.daemon_event_name == DaemonEventName::Init) in.daemon = CleanupReason::DaemonInit;
+    else if (event.daemon_event_name == DaemonEventName::Shutdown) in.daemon = CleanupReason::DaemonShutdown;
+    return apply(in);
+}
+
+std::uint32_t FlowManager::update(const ErrorEventRecord &event) {
+    using F = ErrorEventRecord::Field;
+    if (!event.has(F::alias) || !event.has(F::source)) return kNoFlow;
+    Input in;
+    in.alias = event.alias;
+    in.source = event.source;
+    in.threadId = static_cast<std::uint32_t>(std::max<std::int64_t>(event.thread_id, 0));
+    return apply(in);
+}
+
+std::uint32_t FlowManager::update(EventType type, const EventJson &event) {
+    switch (type) {
+        case EventType::Flow: {
+            FlowEventRecord record;
+            record.parse(event, false);
+            return update(record);
+        }
+        case EventType::Packet: {
+            PacketEventRecord record;
+            record.parse(event, false);
+            return update(record);
+        }
+        case EventType::Daemon: {
+            DaemonEventRecord record;
+            record.parse(event, false);
+            return update(record);
+        }
+        case EventType::Error: {
+            ErrorEventRecord record;
+            record.parse(event, false);
+            return update(record);
+        }
+        default:
+            return kNoFlow;
+    }
+}
+
+std::uint32_t FlowManager::apply(const Input &in) {
+    std::uint32_t instance = instanceOf(in.alias, in.source);
+    std::uint32_t threadId = in.threadId;
+
+    if (in.daemon != CleanupReason::Invalid) {
+        // nDPId (re)started or stopped: its flows on that thread are gone
+        auto it = wheels.find(static_cast<std::uint64_t>(instance) << 32 | threadId);
+        if (it != wheels.end()) drain(*it->second, in.daemon);
+    }
+
+    std::uint32_t slot = kNoFlow;
+    if (in.flow) {
+        slot = find(instance, in.flowId);
+        if (slot == kNil) slot = insert(instance, in.flowId);
+        Record &rec = slab[slot];
+        Flow &flow = rec.flow;
+        flow.lastSeen = std::max(flow.lastSeen, in.lastSeen);
+        if (in.hasIdleTime) flow.idleTime = in.idleTime;
+        if (flow.threadId != threadId) unschedule(slot);
+        flow.threadId = threadId;
+
+        if (in.flowEvent != CleanupReason::Invalid) {
+            remove(slot, in.flowEvent);
+            slot = kNil;
+        }
+        if (slot != kNil) {
+            Wheel &wheel = wheelOf(instance, threadId);
+            unschedule(slot);
+            // this event shows the flow alive, so it is due after `now` at the earliest
+            rec.due = std::max(((flow.lastSeen + flow.idleTime) >> kTickShift) + 1, wheel.now + 1);
+            schedule(wheel, slot);
+        }
+    }
+
+    if (in.threadTs > 0) advance(wheelOf(instance, threadId), in.threadTs >> kTickShift);
+    // the clock may have timed out the event's own flow
+    return slot != kNoFlow && slab[slot].used ? slot : kNoFlow;
+}
+
+bool FlowManager::evict() {
+    Wheel *wheel = lastWheel && lastWheel->count ? lastWheel : nullptr;
+    for (auto it = wheels.begin(); !wheel && it != wheels.end(); ++it) {
+        if (it->second->count) wheel = it->second.get();
+    }
+    if (!wheel) return false;
+    // lists are ordered by due time across slots, not within one; close enough
+    for (unsigned level = 0; level < kLevels; ++level) {
+        if (!wheel->occupied[level]) continue;
+        // first occupied slot at or after the current position
+        auto pos = static_cast<unsigned>((wheel->now >> (level * kSlotBits)) & (kSlots - 1));
+        std::uint64_t bits = wheel->occupied[level];
+        std::uint64_t ahead = bits & (~0ULL << pos);
+        auto idx = static_cast<unsigned>(__builtin_ctzll(ahead ? ahead : bits));
+        remove(wheel->heads[level][idx], CleanupReason::Evicted);
+        return true;
+    }
+    return false;
+}
+
+void FlowManager::shutdown() {
+    for (std::uint32_t slot = 0; slot < slab.size(); ++slot) {
+        if (slab[slot].used) remove(slot, CleanupReason::AppShutdown);
+    }
+    wheels.clear();
+    lastWheelKey = ~0ULL;
+    lastWheel = nullptr;
+}
+
+void FlowManager::schedule(Wheel &wheel, std::uint32_t slot) {
+    Record &rec = slab[slot];
+    unsigned level = 0;
+    while (level < kLevels &&
+           (rec.due >> (level * kSlotBits)) - (wheel.now >> (level * kSlotBits)) >= kSlots) {
+        ++level;
+    }
+    unsigned idx;
+    if (level == kLevels) {
+        // beyond the wheel: park in the last block of the top level and
+        // re-sort from there when it comes up
+        level = kLevels - 1;
+        idx = static_cast<unsigned>(((wheel.now >> (level * kSlotBits)) + kSlots - 1) & (kSlots - 1));
+    } else {
+        idx = static_cast<unsigned>((rec.due >> (level * kSlotBits)) & (kSlots - 1));
+    }
+    std::uint32_t &head = wheel.heads[level][idx];
+    rec.prev = kNil;
+    rec.next = head;
+    if (head != kNil) slab[head].prev = slot;
+    head = slot;
+    rec.bucket = static_cast<std::uint16_t>(level * kSlots + idx);
+    rec.wheel = &wheel;
+    wheel.occupied[level] |= 1ULL << idx;
+    ++wheel.count;
+}
+
+void FlowManager::unschedule(std::uint32_t slot) {
+    Record &rec = slab[slot];
+    if (rec.bucket == kNoBucket) return;
+    Wheel &wheel = *rec.wheel;
+    unsigned level = rec.bucket / kSlots;
+    unsigned idx = rec.bucket % kSlots;
+    if (rec.prev != kNil) slab[rec.prev].next = rec.next;
+    else wheel.heads[level][idx] = rec.next;
+    if (rec.next != kNil) slab[rec.next].prev = rec.prev;
+    if (wheel.heads[level][idx] == kNil) wheel.occupied[level] &= ~(1ULL << idx);
+    rec.bucket = kNoBucket;
+    rec.wheel = nullptr;
+    --wheel.count;
+}
+
+void FlowManager::advance(Wheel &wheel, std::uint64_t tick) {
+    if (tick <= wheel.now) return;
+    if (wheel.count == 0) {
+        wheel.now = tick;
+        return;
+    }
+    if (tick - wheel.now > kMaxStep) {
+        // stepping would cost more than re-sorting what is queued
+        std::vector<std::uint32_t> queued;
+        queued.reserve(wheel.count);
+        for (unsigned level = 0; level < kLevels; ++level) {
+            for (unsigned idx = 0; idx < kSlots; ++idx) {
+                for (auto s = wheel.heads[level][idx]; s != kNil; s = slab[s].next) queued.push_back(s);
+            }
+        }
+        for (auto s : queued) unschedule(s);
+        wheel.now = tick;
+        for (auto s : queued) {
+            if (slab[s].due <= tick) remove(s, CleanupReason::FlowTimeout);
+            else schedule(wheel, s);
+        }
+        return;
+    }
+    while (wheel.now < tick) {
+        std::uint64_t t = wheel.now + 1;
+        wheel.now = t;
+        if ((t & (kSlots - 1)) == 0) cascade(wheel, t);
+        // everything due up to the end of this level-0 rotation
+        std::uint64_t end = std::min(tick, t | (kSlots - 1));
+        std::uint64_t due = wheel.occupied[0] & bitRange(static_cast<unsigned>(t & (kSlots - 1)),
+                                                         static_cast<unsigned>(end & (kSlots - 1)));
+        while (due) {
+            unsigned idx = static_cast<unsigned>(__builtin_ctzll(due));
+            due &= due - 1;
+            wheel.now = (t & ~static_cast<std::uint64_t>(kSlots - 1)) | idx;
+            while (wheel.heads[0][idx] != kNil) remove(wheel.heads[0][idx], CleanupReason::FlowTimeout);
+        }
+        wheel.now = end;
+    }
+}
+
+void FlowManager::cascade(Wheel &wheel, std::uint64_t tick) {
+    // `tick` starts a new block on level 1 and, while the index wraps to 0,
+    // on the levels above; their lists move down to finer slots
+    for (unsigned level = 1; level < kLevels; ++level) {
+        auto idx = static_cast<unsigned>((tick >> (level * kSlotBits)) & (kSlots - 1));
+        std::uint32_t s = wheel.heads[level][idx];
+        wheel.heads[level][idx] = kNil;
+        wheel.occupied[level] &= ~(1ULL << idx);
+        while (s != kNil) {
+            std::uint32_t next = slab[s].next;
+            slab[s].bucket = kNoBucket;
+            --wheel.count;
+            schedule(wheel, s);
+            s = next;
+        }
+        if (idx != 0) break;
+    }
+}
+
+void FlowManager::drain(Wheel &wheel, CleanupReason reason) {
+    for (unsigned level = 0; level < kLevels; ++level) {
+        while (wheel.occupied[level]) {
+            auto idx = static_cast<unsigned>(__builtin_ctzll(wheel.occupied[level]));
+            while (wheel.heads[level][idx] != kNil) remove(wheel.heads[level][idx], reason);
+        }
+    }
+}
+
+std::uint64_t FlowManager::hash(std::uint32_t instance, std::uint64_t flowId) {
+    std::uint64_t h = flowId * 0x9e3779b97f4a7c15ULL ^ instance;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+std::uint32_t FlowManager::find(std::uint32_t instance, std::uint64_t flowId) const {
+    std::uint64_t h = hash(instance, flowId);
+    auto tag = static_cast<std::uint32_t>(h >> 32);
+    for (std::size_t pos = h & mask;; pos = (pos + 1) & mask) {
+        const Bucket &b = index[pos];
+        if (b.slot == 0) return kNil;
+        if (b.tag != tag) continue;
+        const Flow &flow = slab[b.slot - 1].flow;
+        if (flow.flowId == flowId && flow.instance == instance) return b.slot - 1;
+    }
+}
+
+std::uint32_t FlowManager::insert(std::uint32_t instance, std::uint64_t flowId) {
+    if (2 * (active.load(std::memory_order_relaxed) + 1) > index.size()) grow();
+    std::uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = static_cast<std::uint32_t>(slab.size());
+        slab.emplace_back();
+    }
+    Record &rec = slab[slot];
+    rec = Record();
+    rec.flow.flowId = flowId;
+    rec.flow.instance = instance;
+    rec.flow.slot = slot;
+    rec.used = true;
+
+    std::uint64_t h = hash(instance, flowId);
+    std::size_t pos = h & mask;
+    while (index[pos].slot != 0) pos = (pos + 1) & mask;
+    index[pos] = {slot + 1, static_cast<std::uint32_t>(h >> 32)};
+
+    bump(active);
+    auto count = active.load(std::memory_order_relaxed);
+    if (count > peak.load(std::memory_order_relaxed)) peak.store(count, std::memory_order_relaxed);
+    return slot;
+}
+
+void FlowManager::remove(std::uint32_t slot, CleanupReason reason) {
+    Record &rec = slab[slot];
+    if (onCleanup) onCleanup(instances[rec.flow.instance], rec.flow, reason);
+    unschedule(slot);
+    unlinkIndex(slot);
+    rec.used = false;
+    freeSlots.push_back(slot);
+    bump(active, -1);
+    bump(cleanups[static_cast<std::size_t>(reason)]);
+}
+
+void FlowManager::unlinkIndex(std::uint32_t slot) {
+    const Flow &flow = slab[slot].flow;
+    std::size_t pos = hash(flow.instance, flow.flowId) & mask;
+    while (index[pos].slot != slot + 1) pos = (pos + 1) & mask;
+    // backward-shift deletion, as in GeoIPCache
+    index[pos] = {0, 0};
+    for (std::size_t next = (pos + 1) & mask; index[next].slot != 0; next = (next + 1) & mask) {
+        const Flow &moved = slab[index[next].slot - 1].flow;
+        std::size_t home = hash(moved.instance, moved.flowId) & mask;
+        bool movable = next > pos ? (home <= pos || home > next) : (home <= pos && home > next);
+        if (movable) {
+            index[pos] = index[next];
+            index[next] = {0, 0};
+            pos = next;
+        }
+    }
+}
+
+void FlowManager::grow() {
+    index.assign(index.size() * 2, Bucket{0, 0});
+    mask = index.size() - 1;
+    for (std::uint32_t slot = 0; slot < slab.size(); ++slot) {
+        const Record &rec = slab[slot];
+        if (!rec.used) continue;
+        std::uint64_t h = hash(rec.flow.instance, rec.flow.flowId);
+        std::size_t pos = h & mask;
+        while (index[pos].slot != 0) pos = (pos + 1) & mask;
+        index[pos] = {slot + 1, static_cast<std::uint32_t>(h >> 32)};
+    }
+}
+
+std::string FlowManager::stats() const {
+    std::ostringstream ss;
+    ss << "active=" << active.load(std::memory_order_relaxed)
+       << " peak=" << peak.load(std::memory_order_relaxed) << " cleanups{";
+    for (std::size_t r = 1; r < cleanups.size(); ++r) {
+        if (r > 1) ss << ' ';
+        ss << reasonName(static_cast<CleanupReason>(r)) << '=' << cleanups[r].load(std::memory_order_relaxed);
+    }
+    ss << '}';
+    return ss.str();
+}
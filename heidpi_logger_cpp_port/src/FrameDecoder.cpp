@@ -0,0 +1,46 @@
+#include "FrameDecoder.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// nDPIsrvd never sends anywhere near this much; more digits means garbage.
+constexpr std::size_t kMaxDigits = 9;
+}
+
+FrameDecoder::FrameDecoder(std::size_t capacity) : buf(capacity) {}
+
+std::pair<char *, std::size_t> FrameDecoder::writable() {
+    if (tail == buf.size() && head > 0) {
+        std::memmove(buf.data(), buf.data() + head, tail - head);
+        tail -= head;
+        head = 0;
+    }
+    if (tail == buf.size()) {
+        buf.resize(std::max(buf.size() * 2, pending));
+    }
+    return {buf.data() + tail, buf.size() - tail};
+}
+
+bool FrameDecoder::drain(const std::function<void(std::string_view)> &cb) {
+    while (head < tail) {
+        const char *p = buf.data() + head;
+        std::size_t avail = tail - head;
+        std::size_t digits = 0;
+        std::size_t len = 0;
+        while (digits < avail && digits <= kMaxDigits && p[digits] >= '0' && p[digits] <= '9') {
+            len = len * 10 + static_cast<std::size_t>(p[digits] - '0');
+            ++digits;
+        }
+        if (digits == avail && digits <= kMaxDigits) break; // prefix incomplete
+        if (digits == 0 || digits > kMaxDigits || p[digits] != '{') return false;
+        if (avail - digits < len) {
+            pending = digits + len;
+            break;
+        }
+        cb(std::string_view(p + digits, len));
+        head += digits + len;
+        pending = 0;
+    }
+    if (head == tail) head = tail = 0;
+    return true;
+}
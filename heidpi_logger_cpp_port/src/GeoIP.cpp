@@ -1,70 +1,128 @@
 #include "GeoIP.hpp"
+#include "JsonWriter.hpp"
 #include "Logger.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
 #include <sstream>
 
 namespace {
-nlohmann::json entryToJson(const MMDB_s &db, const MMDB_entry_data_s &entry) {
-    switch (entry.type) {
+// Decodes the value starting at `node` of a flattened entry data list into
+// `out` and returns the node following it (nested maps/arrays inline).
+// `Json` is nlohmann::json for cached results or EventJson for results
+// decoded straight into an event.
+template <typename Json>
+const MMDB_entry_data_list_s *decode(const MMDB_entry_data_list_s *node, Json &out) {
+    if (!node) return nullptr;
+    const MMDB_entry_data_s &data = node->entry_data;
+    node = node->next;
+    switch (data.type) {
+        case MMDB_DATA_TYPE_MAP:
+            out = Json::object();
+            for (std::uint32_t i = 0; i < data.data_size && node; ++i) {
+                const MMDB_entry_data_s &key = node->entry_data;
+                node = node->next;
+                if (key.type != MMDB_DATA_TYPE_UTF8_STRING) {
+                    Json skipped;
+                    node = decode(node, skipped);
+                    continue;
+                }
+                node = decode(node, out[std::string_view(key.utf8_string, key.data_size)]);
+            }
+            break;
+        case MMDB_DATA_TYPE_ARRAY:
+            out = Json::array();
+            for (std::uint32_t i = 0; i < data.data_size && node; ++i) {
+                out.push_back(nullptr);
+                node = decode(node, out.back());
+            }
+            break;
         case MMDB_DATA_TYPE_UTF8_STRING:
-            return std::string(entry.utf8_string, entry.data_size);
+            out = typename Json::string_t(data.utf8_string, data.data_size);
+            break;
         case MMDB_DATA_TYPE_DOUBLE:
-            return entry.double_value;
+            out = data.double_value;
+            break;
         case MMDB_DATA_TYPE_FLOAT:
-            return entry.float_value;
+            out = data.float_value;
+            break;
         case MMDB_DATA_TYPE_UINT16:
-            return entry.uint16;
+            out = data.uint16;
+            break;
         case MMDB_DATA_TYPE_UINT32:
-            return entry.uint32;
+            out = data.uint32;
+            break;
         case MMDB_DATA_TYPE_INT32:
-            return entry.int32;
+            out = data.int32;
+            break;
         case MMDB_DATA_TYPE_UINT64:
-            return entry.uint64;
-        case MMDB_DATA_TYPE_BOOLEAN:
-            return static_cast<bool>(entry.boolean);
-        case MMDB_DATA_TYPE_MAP: {
-            MMDB_entry_s sub{&db, entry.offset};
-            MMDB_entry_data_list_s *list = nullptr;
-            if (MMDB_get_entry_data_list(&sub, &list) == MMDB_SUCCESS && list) {
-                nlohmann::json obj = nlohmann::json::object();
-                MMDB_entry_data_list_s *ptr = list;
-                while (ptr && ptr->next) {
-                    auto key = ptr->entry_data;
-                    ptr = ptr->next;
-                    auto val = ptr->entry_data;
-                    ptr = ptr->next;
-                    if (key.type != MMDB_DATA_TYPE_UTF8_STRING) continue;
-                    std::string k(key.utf8_string, key.data_size);
-                    obj[k] = entryToJson(db, val);
-                }
-                MMDB_free_entry_data_list(list);
-                return obj;
-            }
+            out = data.uint64;
             break;
-        }
-        case MMDB_DATA_TYPE_ARRAY: {
-            MMDB_entry_s sub{&db, entry.offset};
-            MMDB_entry_data_list_s *list = nullptr;
-            if (MMDB_get_entry_data_list(&sub, &list) == MMDB_SUCCESS && list) {
-                nlohmann::json arr = nlohmann::json::array();
-                MMDB_entry_data_list_s *ptr = list;
-                while (ptr) {
-                    arr.push_back(entryToJson(db, ptr->entry_data));
-                    ptr = ptr->next;
-                }
-                MMDB_free_entry_data_list(list);
-                return arr;
-            }
+        case MMDB_DATA_TYPE_BOOLEAN:
+            out = static_cast<bool>(data.boolean);
             break;
-        }
         default:
+            out = nullptr;
             break;
     }
-    return {};
+    return node;
+}
+
+template <typename Json>
+void entryToJson(const MMDB_s &db, const MMDB_entry_data_s &entry, Json &out) {
+    if (entry.type != MMDB_DATA_TYPE_MAP && entry.type != MMDB_DATA_TYPE_ARRAY) {
+        MMDB_entry_data_list_s single{};
+        single.entry_data = entry;
+        decode(&single, out);
+        return;
+    }
+    MMDB_entry_s sub{&db, entry.offset};
+    MMDB_entry_data_list_s *list = nullptr;
+    if (MMDB_get_entry_data_list(&sub, &list) == MMDB_SUCCESS && list) {
+        decode(list, out);
+    } else {
+        out = nullptr;
+    }
+    MMDB_free_entry_data_list(list);
 }
+// Answer for addresses with no result.
+const GeoIPCache::Result noResult;
+// Serialized result of the current lookup if no cache holds it.
+thread_local std::string scratch;
+
+// Ids of the GeoIP instances alive; `retired` counts destroyed ones so the
+// threads know when to prune their cache lists.
+std::mutex liveMtx;
+std::vector<std::uint64_t> liveIds;
+std::atomic<std::uint64_t> retired{0};
 } // namespace
 
-GeoIP::GeoIP(const std::string &path, const std::vector<std::string> &k)
-    : keys(k) {
+GeoIP::GeoIP(const EventConfig &cfg)
+    : keys(cfg.geoip_keys.size()), cacheSize(cfg.geoip_cache_size),
+      recordCacheSize(cfg.geoip_record_cache_size) {
+    static std::atomic<std::uint64_t> nextId{1};
+    id = nextId.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(liveMtx);
+        liveIds.push_back(id);
+    }
+    // split "a.b.c" once; `path` points into `parts`, which is never resized again
+    for (std::size_t i = 0; i < cfg.geoip_keys.size(); ++i) {
+        auto &key = keys[i];
+        std::stringstream ss(cfg.geoip_keys[i]);
+        std::string part;
+        while (std::getline(ss, part, '.')) key.parts.push_back(part);
+        if (key.parts.empty()) key.parts.emplace_back();
+        for (const auto &p : key.parts) key.path.push_back(p.c_str());
+        key.path.push_back(nullptr);
+        key.field = key.parts.back();
+    }
+    if (cfg.geoip_bypass_reserved) bypass.addReserved();
+    for (const auto &rule : cfg.geoip_bypass) bypass.add(rule.first, rule.second);
+    bypass.build();
+
+    const std::string &path = cfg.geoip_path;
     int status = MMDB_open(path.c_str(), MMDB_MODE_MMAP, &mmdb);
     if (status != MMDB_SUCCESS) {
         Logger::error(std::string("GeoIP open failed: ") + path + " " + MMDB_strerror(status));
@@ -72,51 +130,233 @@ GeoIP::GeoIP(const std::string &path, const std::vector<std::string> &k)
     } else {
         loaded = true;
     }
+    if (loaded && cfg.geoip_flat_table) {
+        auto start = std::chrono::steady_clock::now();
+        bool built = table.build(mmdb, [this](MMDB_entry_s &record, nlohmann::json &result) {
+            collect(record, result);
+        }, cfg.geoip_flat_table_max_mb << 20);
+        tableBuildMs = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        if (built) {
+            Logger::info("GeoIP flat table for " + path + ": " + std::to_string(table.v4Ranges()) +
+                         " IPv4 and " + std::to_string(table.v6Ranges()) + " IPv6 ranges, " +
+                         std::to_string(table.results()) + " distinct results, " +
+                         std::to_string(table.memory() >> 10) + " KiB, " +
+                         std::to_string(tableBuildMs) + " ms");
+        } else {
+            Logger::error("GeoIP flat table not built for " + path +
+                          " (malformed tree or over flat_table_max_mb), using the tree");
+        }
+    }
 }
 
 GeoIP::~GeoIP() {
+    if (id != 0) {
+        std::lock_guard<std::mutex> lock(liveMtx);
+        liveIds.erase(std::find(liveIds.begin(), liveIds.end(), id));
+        retired.fetch_add(1, std::memory_order_release);
+    }
     if (loaded) {
         MMDB_close(&mmdb);
     }
 }
 
-nlohmann::json GeoIP::lookup(const std::string &ip) const {
-    nlohmann::json result;
-    if (!loaded || ip.empty()) return result;
-    int gai_error = 0, mmdb_error = 0;
-    MMDB_lookup_result_s res = MMDB_lookup_string(&mmdb, ip.c_str(), &gai_error, &mmdb_error);
-    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS || !res.found_entry) {
-        return result;
+bool GeoIP::parseAddress(std::string_view ip, sockaddr_storage &addr) {
+    // inet_pton wants a terminated string
+    char text[INET6_ADDRSTRLEN];
+    if (ip.empty() || ip.size() >= sizeof(text)) return false;
+    ip.copy(text, ip.size());
+    text[ip.size()] = '\0';
+    if (ip.find(':') != std::string_view::npos) {
+        auto *in6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+        in6->sin6_family = AF_INET6;
+        return inet_pton(AF_INET6, text, &in6->sin6_addr) == 1;
     }
+    auto *in = reinterpret_cast<sockaddr_in *>(&addr);
+    in->sin_family = AF_INET;
+    return inet_pton(AF_INET, text, &in->sin_addr) == 1;
+}
+
+template <typename Json>
+void GeoIP::collect(MMDB_entry_s &record, Json &result) const {
     for (const auto &key : keys) {
-        std::vector<std::string> parts;
-        std::stringstream ss(key);
-        std::string part;
-        while (std::getline(ss, part, '.')) parts.push_back(part);
-        std::vector<const char*> path;
-        for (auto &p : parts) path.push_back(p.c_str());
-        path.push_back(nullptr);
         MMDB_entry_data_s entry{};
-        int status = MMDB_aget_value(&res.entry, &entry, path.data());
+        int status = MMDB_aget_value(&record, &entry, key.path.data());
         if (status != MMDB_SUCCESS || !entry.has_data) continue;
-        const std::string &field = parts.back();
-        nlohmann::json value = entryToJson(mmdb, entry);
-        if (!value.is_null() && !(value.is_object() && value.empty())) {
-            result[field] = value;
+        Json &value = result[std::string_view(key.field)];
+        entryToJson(mmdb, entry, value);
+        if (value.is_null() || (value.is_object() && value.empty())) {
+            result.erase(std::string_view(key.field));
         }
     }
+}
+
+GeoIP::ThreadCaches &GeoIP::localCaches() const {
+    // owner ids instead of pointers: a new GeoIP may reuse a freed address
+    thread_local std::vector<std::pair<std::uint64_t, ThreadCaches *>> local;
+    thread_local std::uint64_t seenRetired = 0;
+    auto nowRetired = retired.load(std::memory_order_acquire);
+    if (nowRetired != seenRetired) {
+        // drop the caches of instances a reload has replaced since
+        std::lock_guard<std::mutex> lock(liveMtx);
+        local.erase(std::remove_if(local.begin(), local.end(),
+                                   [](const auto &entry) {
+                                       return std::find(liveIds.begin(), liveIds.end(), entry.first) == liveIds.end();
+                                   }),
+                    local.end());
+        seenRetired = nowRetired;
+    }
+    for (auto &entry : local) {
+        if (entry.first == id) return *entry.second;
+    }
+    auto caches = std::make_unique<ThreadCaches>();
+    if (cacheSize > 0) caches->addresses = std::make_unique<GeoIPCache>(cacheSize);
+    if (recordCacheSize > 0) caches->records = std::make_unique<GeoIPCache>(recordCacheSize);
+    std::lock_guard<std::mutex> lock(cachesMtx);
+    threadCaches.push_back(std::move(caches));
+    local.emplace_back(id, threadCaches.back().get());
+    return *threadCaches.back();
+}
+
+std::shared_ptr<const GeoIPCache::Result> GeoIP::build(MMDB_entry_s &record) const {
+    auto result = std::make_shared<GeoIPCache::Result>();
+    collect(record, result->value);
+    if (result->value.empty()) return nullptr;
+    result->fragment = result->value.dump();
     return result;
 }
 
-void GeoIP::enrich(const std::string &src_ip, const std::string &dst_ip,
-                   nlohmann::json &out) const {
+const GeoIPCache::Result &GeoIP::resolve(std::string_view ip, MMDB_entry_s &uncached) const {
+    uncached = MMDB_entry_s{};
+    sockaddr_storage addr{};
+    if (!parseAddress(ip, addr)) return noResult;
+    auto key = GeoIPCache::keyOf(addr);
+    ThreadCaches &local = localCaches();
+
+    // private/reserved and configured networks never reach the database
+    if (const auto *fixed = bypass.find(key)) {
+        local.bypassed.store(local.bypassed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return *fixed;
+    }
+
+    // the table holds every result parsed and serialized already
+    if (const auto *flat = table.empty() ? nullptr : table.find(key)) {
+        local.flat.store(local.flat.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return *flat;
+    }
+
+    GeoIPCache *addresses = local.addresses.get();
+    GeoIPCache::Entry *entry = nullptr;
+    if (addresses) {
+        if (auto *hit = addresses->find(key)) return hit->result ? *hit->result : noResult;
+        entry = &addresses->insert(key);
+    }
+
+    int mmdb_error = 0;
+    MMDB_lookup_result_s res =
+        MMDB_lookup_sockaddr(&mmdb, reinterpret_cast<const sockaddr *>(&addr), &mmdb_error);
+    if (mmdb_error != MMDB_SUCCESS || !res.found_entry) return noResult;
+    if (!local.records) {
+        if (!addresses) {
+            // nothing keeps the result: skip the heap copy, the caller
+            // decodes the record into the event's arena
+            uncached = res.entry;
+            return noResult;
+        }
+        addresses->fill(*entry, build(res.entry));
+        return entry->result ? *entry->result : noResult;
+    }
+
+    // all addresses of one network share the data record: build its result
+    // once, address entries only take a reference to it
+    auto &records = *local.records;
+    GeoIPCache::Key recordKey{0, res.entry.offset};
+    auto *record = records.find(recordKey);
+    if (!record) {
+        record = &records.insert(recordKey);
+        records.fill(*record, build(res.entry));
+    }
+    if (addresses) addresses->fill(*entry, record->result);
+    return record->result ? *record->result : noResult;
+}
+
+void GeoIP::enrich(std::string_view src_ip, std::string_view dst_ip, EventJson &out) const {
     if (!loaded) return;
-    auto src = lookup(src_ip);
-    if (!src.empty()) {
-        out["src_geoip2_city"] = src;
+    auto add = [&](const char *member, std::string_view ip) {
+        MMDB_entry_s record{};
+        const auto &result = resolve(ip, record);
+        if (record.mmdb) {
+            EventJson value = EventJson::object();
+            collect(record, value);
+            if (!value.empty()) out[member] = std::move(value);
+            return;
+        }
+        if (result.value.empty()) return;
+        // copied into the event's own allocator
+        out[member] = EventJson(result.value);
+    };
+    add("src_geoip2_city", src_ip);
+    add("dst_geoip2_city", dst_ip);
+}
+
+void GeoIP::enrichRaw(std::string_view src_ip, std::string_view dst_ip, EventString &line) const {
+    if (!loaded) return;
+    auto append = [&](const char *member, std::string_view ip) {
+        MMDB_entry_s record{};
+        std::string_view fragment = resolve(ip, record).fragment;
+        if (record.mmdb) {
+            // decoded in the event's arena, serialized into the reused scratch buffer
+            EventJson value = EventJson::object();
+            collect(record, value);
+            if (value.empty()) return;
+            scratch.clear();
+            JsonWriter(scratch).value(value);
+            discardJson(value);
+            fragment = scratch;
+        }
+        if (fragment.empty()) return;
+        line += member;
+        line += fragment;
+    };
+    append(",\"src_geoip2_city\":", src_ip);
+    append(",\"dst_geoip2_city\":", dst_ip);
+}
+
+std::string GeoIP::stats() const {
+    std::lock_guard<std::mutex> lock(cachesMtx);
+    std::ostringstream ss;
+    auto report = [&](const char *name, std::unique_ptr<GeoIPCache> ThreadCaches::*member, std::size_t capacity) {
+        std::uint64_t hits = 0, misses = 0, evictions = 0;
+        std::size_t entries = 0, memory = 0;
+        for (const auto &caches : threadCaches) {
+            const auto &cache = *((*caches).*member);
+            hits += cache.hits();
+            misses += cache.misses();
+            evictions += cache.evictions();
+            entries += cache.size();
+            memory += cache.memory();
+        }
+        if (ss.tellp() > 0) ss << ' ';
+        ss << name << "{threads=" << threadCaches.size()
+           << " entries=" << entries << '/' << threadCaches.size() * capacity
+           << " hits=" << hits << " misses=" << misses
+           << " hit_rate=" << (hits + misses ? 100 * hits / (hits + misses) : 0) << '%'
+           << " evictions=" << evictions << " memory_kb=" << memory / 1024 << '}';
+    };
+    if (!bypass.empty()) {
+        std::uint64_t bypassed = 0;
+        for (const auto &caches : threadCaches) bypassed += caches->bypassed.load(std::memory_order_relaxed);
+        ss << "bypassed=" << bypassed;
     }
-    auto dst = lookup(dst_ip);
-    if (!dst.empty()) {
-        out["dst_geoip2_city"] = dst;
+    if (!table.empty()) {
+        std::uint64_t flat = 0;
+        for (const auto &caches : threadCaches) flat += caches->flat.load(std::memory_order_relaxed);
+        if (ss.tellp() > 0) ss << ' ';
+        ss << "flat{ranges=" << table.v4Ranges() << '+' << table.v6Ranges()
+           << " results=" << table.results() << " memory_kb=" << table.memory() / 1024
+           << " build_ms=" << tableBuildMs << " lookups=" << flat << '}';
     }
-}
\ No newline at end of file
+    if (cacheSize > 0) report("addresses", &ThreadCaches::addresses, cacheSize);
+    if (recordCacheSize > 0) report("records", &ThreadCaches::records, recordCacheSize);
+    return ss.str();
+}
@@ -0,0 +1,145 @@
+#include "GeoIPCache.hpp"
+#include <endian.h>
+#include <netinet/in.h>
+#include <cstring>
+
+namespace {
+std::size_t stringHeap(const std::string &s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0; // beyond the small-string buffer
+}
+
+std::size_t jsonHeap(const nlohmann::json &v) {
+    constexpr std::size_t kMapNode = 32 + sizeof(nlohmann::json::object_t::value_type);
+    switch (v.type()) {
+        case nlohmann::json::value_t::object: {
+            std::size_t n = sizeof(nlohmann::json::object_t);
+            for (const auto &member : v.get_ref<const nlohmann::json::object_t &>()) {
+                n += kMapNode + stringHeap(member.first) + jsonHeap(member.second);
+            }
+            return n;
+        }
+        case nlohmann::json::value_t::array: {
+            const auto &items = v.get_ref<const nlohmann::json::array_t &>();
+            std::size_t n = sizeof(nlohmann::json::array_t) + items.capacity() * sizeof(nlohmann::json);
+            for (const auto &item : items) n += jsonHeap(item);
+            return n;
+        }
+        case nlohmann::json::value_t::string:
+            return sizeof(std::string) + stringHeap(v.get_ref<const std::string &>());
+        default:
+            return 0;
+    }
+}
+
+// a result of the cache's own, with the shared_ptr control block
+std::size_t ownedSize(const GeoIPCache::Result &result) {
+    return sizeof(GeoIPCache::Result) + 16 + GeoIPCache::heapSize(result);
+}
+} // namespace
+
+GeoIPCache::GeoIPCache(std::size_t capacity) : slots(capacity) {
+    std::size_t size = 1;
+    while (size < 2 * capacity) size <<= 1;
+    index.assign(size, 0);
+    mask = size - 1;
+}
+
+GeoIPCache::Key GeoIPCache::keyOf(const sockaddr_storage &addr) {
+    unsigned char bytes[16] = {};
+    if (addr.ss_family == AF_INET6) {
+        std::memcpy(bytes, &reinterpret_cast<const sockaddr_in6 &>(addr).sin6_addr, 16);
+    } else {
+        bytes[10] = 0xff;
+        bytes[11] = 0xff;
+        std::memcpy(bytes + 12, &reinterpret_cast<const sockaddr_in &>(addr).sin_addr, 4);
+    }
+    // big-endian halves, so keys order like addresses (see CidrTable)
+    std::uint64_t hi, lo;
+    std::memcpy(&hi, bytes, 8);
+    std::memcpy(&lo, bytes + 8, 8);
+    return {be64toh(hi), be64toh(lo)};
+}
+
+std::size_t GeoIPCache::heapSize(const Result &result) {
+    return jsonHeap(result.value) + stringHeap(result.fragment);
+}
+
+std::size_t GeoIPCache::hash(const Key &key) {
+    std::uint64_t h = key.hi * 0x9e3779b97f4a7c15ULL ^ key.lo;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<std::size_t>(h);
+}
+
+GeoIPCache::Entry *GeoIPCache::find(const Key &key) {
+    for (std::size_t pos = hash(key) & mask;; pos = (pos + 1) & mask) {
+        std::uint32_t slot = index[pos];
+        if (slot == 0) break;
+        Entry &entry = slots[slot - 1];
+        if (entry.key == key) {
+            entry.referenced = true;
+            hitCount.store(hitCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return &entry;
+        }
+    }
+    missCount.store(missCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+GeoIPCache::Entry &GeoIPCache::insert(const Key &key) {
+    std::size_t slot;
+    std::size_t count = used.load(std::memory_order_relaxed);
+    if (count < slots.size()) {
+        slot = count;
+        used.store(count + 1, std::memory_order_relaxed);
+    } else {
+        // CLOCK: skip (and clear) recently referenced entries
+        while (slots[hand].referenced) {
+            slots[hand].referenced = false;
+            hand = (hand + 1) % slots.size();
+        }
+        slot = hand;
+        hand = (hand + 1) % slots.size();
+        unlink(slot);
+        evictionCount.store(evictionCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    Entry &entry = slots[slot];
+    fill(entry, nullptr);
+    entry.key = key;
+    entry.referenced = false;
+
+    std::size_t pos = hash(key) & mask;
+    while (index[pos] != 0) pos = (pos + 1) & mask;
+    index[pos] = static_cast<std::uint32_t>(slot + 1);
+    return entry;
+}
+
+void GeoIPCache::fill(Entry &entry, std::shared_ptr<const Result> result) {
+    if (entry.owner) resultBytes.fetch_sub(ownedSize(*entry.result), std::memory_order_relaxed);
+    entry.owner = result && result.use_count() == 1;
+    if (entry.owner) resultBytes.fetch_add(ownedSize(*result), std::memory_order_relaxed);
+    entry.result = std::move(result);
+}
+
+void GeoIPCache::unlink(std::size_t slot) {
+    std::size_t pos = hash(slots[slot].key) & mask;
+    while (index[pos] != slot + 1) pos = (pos + 1) & mask;
+    // backward-shift deletion keeps probe sequences intact without tombstones
+    index[pos] = 0;
+    for (std::size_t next = (pos + 1) & mask; index[next] != 0; next = (next + 1) & mask) {
+        std::size_t home = hash(slots[index[next] - 1].key) & mask;
+        bool movable = next > pos ? (home <= pos || home > next) : (home <= pos && home > next);
+        if (movable) {
+            index[pos] = index[next];
+            index[next] = 0;
+            pos = next;
+        }
+    }
+}
+
+std::size_t GeoIPCache::memory() const {
+    return slots.size() * sizeof(Entry) + index.size() * sizeof(std::uint32_t) +
+           resultBytes.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,212 @@
+#include "GeoIPTable.hpp"
+#include <unordered_map>
+
+namespace {
+using Key = GeoIPCache::Key;
+
+// Index of the last element <= `x` in a sorted array whose first element
+// is <= every `x` (the ranges start at address 0). The loop has a fixed
+// trip count for a given size and compiles to conditional moves.
+template <typename T, typename Less>
+std::size_t lastNotAbove(const std::vector<T> &starts, const T &x, Less less) {
+    const T *base = starts.data();
+    std::size_t n = starts.size();
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = less(x, base[half]) ? base : base + half;
+        n -= half;
+    }
+    return static_cast<std::size_t>(base - starts.data());
+}
+
+bool keyLess(const Key &a, const Key &b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+// v4-mapped IPv6 (::ffff:0:0/96), how GeoIPCache keys IPv4 addresses
+bool isV4(const Key &key) {
+    return key.hi == 0 && (key.lo >> 32) == 0xffff;
+}
+
+std::size_t stringHeap(const std::string &s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0; // beyond the small-string buffer
+}
+
+// per element of the build-time maps: node, key and bucket
+constexpr std::size_t kOffsetNode = 32;
+constexpr std::size_t kTextNode = 24 + sizeof(std::string);
+} // namespace
+
+struct GeoIPTable::Builder {
+    // one record of a search node: a child node, a data record or nothing
+    struct Record {
+        std::uint8_t type;
+        std::uint64_t node;
+        MMDB_entry_s entry;
+    };
+
+    Builder(GeoIPTable &t, const MMDB_s &d, const Collect &c, std::size_t max)
+        : table(t), db(d), collect(c), maxBytes(max) {}
+
+    GeoIPTable &table;
+    const MMDB_s &db;
+    const Collect &collect;
+    std::size_t maxBytes;
+    std::unordered_map<std::uint32_t, std::uint32_t> byOffset; // data record -> value
+    std::unordered_map<std::string, std::uint32_t> byText;      // fragment -> value
+    std::size_t mapBytes{0}; // approximate heap use of the two maps
+    std::uint64_t v4Node{0};
+    bool v4IsNode{false};
+    std::uint64_t visited{0};
+    bool ok{true};
+
+    bool read(std::uint64_t node, Record &left, Record &right) {
+        if (node >= db.metadata.node_count || ++visited > db.metadata.node_count + 128) {
+            return ok = false;
+        }
+        MMDB_search_node_s sn{};
+        if (MMDB_read_node(&db, static_cast<std::uint32_t>(node), &sn) != MMDB_SUCCESS) return ok = false;
+        left = {sn.left_record_type, sn.left_record, sn.left_record_entry};
+        right = {sn.right_record_type, sn.right_record, sn.right_record_entry};
+        return true;
+    }
+
+    std::uint32_t value(const Record &rec) {
+        if (rec.type == MMDB_RECORD_TYPE_EMPTY) return kNone;
+        if (rec.type != MMDB_RECORD_TYPE_DATA) {
+            ok = false;
+            return kNone;
+        }
+        auto it = byOffset.find(rec.entry.offset);
+        if (it != byOffset.end()) return it->second;
+        MMDB_entry_s entry = rec.entry;
+        nlohmann::json result;
+        collect(entry, result);
+        std::uint32_t v = kNone;
+        if (!result.empty()) {
+            auto text = result.dump();
+            auto known = byText.find(text);
+            if (known != byText.end()) {
+                v = known->second;
+            } else {
+                // kept parsed as well, so DOM lookups copy instead of parsing
+                v = static_cast<std::uint32_t>(table.entries.size());
+                table.entries.emplace_back();
+                auto &added = table.entries.back();
+                added.value = std::move(result);
+                added.fragment = text;
+                table.entryBytes += GeoIPCache::heapSize(added);
+                mapBytes += kTextNode + stringHeap(text);
+                byText.emplace(std::move(text), v);
+                checkSize();
+            }
+        }
+        byOffset.emplace(rec.entry.offset, v);
+        mapBytes += kOffsetNode;
+        return v;
+    }
+
+    void checkSize() {
+        std::size_t buckets = (byOffset.bucket_count() + byText.bucket_count()) * sizeof(void *);
+        if (table.memory() + mapBytes + buckets > maxBytes) ok = false;
+    }
+
+    // `rec` covers the addresses starting with the first `depth` bits of `prefix`
+    void walkV4(const Record &rec, std::uint32_t prefix, unsigned depth) {
+        if (!ok) return;
+        if (rec.type != MMDB_RECORD_TYPE_SEARCH_NODE || depth == 32) {
+            std::uint32_t v = value(rec);
+            if (table.v4Value.empty() || table.v4Value.back() != v) {
+                table.v4Start.push_back(prefix);
+                table.v4Value.push_back(v);
+                checkSize();
+            }
+            return;
+        }
+        Record left{}, right{};
+        if (!read(rec.node, left, right)) return;
+        walkV4(left, prefix, depth + 1);
+        walkV4(right, prefix | (1U << (31 - depth)), depth + 1);
+    }
+
+    // as walkV4, over all 128 bits
+    void walkV6(const Record &rec, Key prefix, unsigned depth) {
+        if (!ok) return;
+        bool node = rec.type == MMDB_RECORD_TYPE_SEARCH_NODE && depth < 128;
+        if (!node || (v4IsNode && rec.node == v4Node)) {
+            // the IPv4 tree and its aliases (::/96, ::ffff:0:0/96, 2002::/16)
+            // are answered from the IPv4 array or by the database itself
+            std::uint32_t v = node ? kFallback : value(rec);
+            if (table.v6Value.empty() || table.v6Value.back() != v) {
+                table.v6Start.push_back(prefix);
+                table.v6Value.push_back(v);
+                checkSize();
+            }
+            return;
+        }
+        Record left{}, right{};
+        if (!read(rec.node, left, right)) return;
+        walkV6(left, prefix, depth + 1);
+        Key upper = prefix;
+        if (depth < 64) upper.hi |= 1ULL << (63 - depth);
+        else upper.lo |= 1ULL << (127 - depth);
+        walkV6(right, upper, depth + 1);
+    }
+
+    void run() {
+        Record root{MMDB_RECORD_TYPE_SEARCH_NODE, 0, {}};
+        if (db.metadata.node_count == 0) {
+            ok = false;
+            return;
+        }
+        if (db.metadata.ip_version == 4) {
+            walkV4(root, 0, 0);
+            return;
+        }
+        // IPv4 lives below ::/96
+        Record v4 = root, unused{};
+        for (unsigned depth = 0; depth < 96 && v4.type == MMDB_RECORD_TYPE_SEARCH_NODE; ++depth) {
+            if (!read(v4.node, v4, unused)) return;
+        }
+        v4IsNode = v4.type == MMDB_RECORD_TYPE_SEARCH_NODE;
+        v4Node = v4.node;
+        walkV4(v4, 0, 0);
+        walkV6(root, Key{}, 0);
+    }
+};
+
+bool GeoIPTable::build(const MMDB_s &db, const Collect &collect, std::size_t maxBytes) {
+    *this = GeoIPTable();
+    Builder builder(*this, db, collect, maxBytes);
+    builder.run();
+    if (!builder.ok) {
+        *this = GeoIPTable();
+        return false;
+    }
+    v4Start.shrink_to_fit();
+    v4Value.shrink_to_fit();
+    v6Start.shrink_to_fit();
+    v6Value.shrink_to_fit();
+    entries.shrink_to_fit();
+    return true;
+}
+
+const GeoIPCache::Result *GeoIPTable::find(const Key &key) const {
+    std::uint32_t value;
+    if (isV4(key)) {
+        if (v4Start.empty()) return nullptr;
+        auto addr = static_cast<std::uint32_t>(key.lo);
+        value = v4Value[lastNotAbove(v4Start, addr, [](std::uint32_t a, std::uint32_t b) { return a < b; })];
+    } else {
+        if (v6Start.empty()) return nullptr;
+        value = v6Value[lastNotAbove(v6Start, key, keyLess)];
+    }
+    if (value == kFallback) return nullptr;
+    return value == kNone ? &none : &entries[value];
+}
+
+std::size_t GeoIPTable::memory() const {
+    return v4Start.capacity() * sizeof(std::uint32_t) + v4Value.capacity() * sizeof(std::uint32_t) +
+           v6Start.capacity() * sizeof(Key) + v6Value.capacity() * sizeof(std::uint32_t) +
+           entries.capacity() * sizeof(GeoIPCache::Result) + entryBytes;
+}
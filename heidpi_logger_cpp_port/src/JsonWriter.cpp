@@ -0,0 +1,137 @@
+#include "JsonWriter.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Length of the leading run of `s` that needs no escaping: no '"', '\\'
+// or control character below 0x20.
+std::size_t plainRun(const char *s, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        // unsigned x <= 0x1f  <=>  max(x, 0x1f) == 0x1f
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+#endif
+    for (; i < n; ++i) {
+        auto c = static_cast<unsigned char>(s[i]);
+        if (c == '"' || c == '\\' || c < 0x20) break;
+    }
+    return i;
+}
+
+template <typename T>
+void appendInteger(std::string &out, T v) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, static_cast<std::size_t>(res.ptr - buf));
+}
+} // namespace
+
+void JsonWriter::integer(std::uint64_t v) {
+    appendInteger(out, v);
+}
+
+void JsonWriter::integer(std::int64_t v) {
+    appendInteger(out, v);
+}
+
+void JsonWriter::string(std::string_view s) {
+    out += '"';
+    const char *p = s.data();
+    std::size_t n = s.size();
+    while (n > 0) {
+        std::size_t run = plainRun(p, n);
+        out.append(p, run);
+        if (run == n) break;
+        auto c = static_cast<unsigned char>(p[run]);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                out.append(esc, sizeof(esc));
+            }
+        }
+        p += run + 1;
+        n -= run + 1;
+    }
+    out += '"';
+}
+
+void JsonWriter::value(const EventJson &v) {
+    using value_t = EventJson::value_t;
+    switch (v.type()) {
+        case value_t::object: {
+            out += '{';
+            bool first = true;
+            for (const auto &member : v.get_ref<const EventJson::object_t &>()) {
+                if (!first) out += ',';
+                first = false;
+                key(member.first);
+                value(member.second);
+            }
+            out += '}';
+            return;
+        }
+        case value_t::array: {
+            out += '[';
+            bool first = true;
+            for (const auto &element : v.get_ref<const EventJson::array_t &>()) {
+                if (!first) out += ',';
+                first = false;
+                value(element);
+            }
+            out += ']';
+            return;
+        }
+        case value_t::string:
+            string(v.get_ref<const EventString &>());
+            return;
+        case value_t::boolean:
+            out += v.get<bool>() ? "true" : "false";
+            return;
+        case value_t::number_integer:
+            integer(v.get<std::int64_t>());
+            return;
+        case value_t::number_unsigned:
+            integer(v.get<std::uint64_t>());
+            return;
+        case value_t::number_float: {
+            double d = v.get<double>();
+            if (!std::isfinite(d)) {
+                out += "null";
+                return;
+            }
+            // same digits as dump(); std::to_chars may pick others in rare cases
+            char buf[64];
+            char *end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), d);
+            out.append(buf, static_cast<std::size_t>(end - buf));
+            return;
+        }
+        case value_t::null:
+            out += "null";
+            return;
+        default: // binary, discarded: never in events
+            out += v.dump();
+            return;
+    }
+}
@@ -10,7 +10,8 @@ std::ofstream Logger::file;
 static std::string timestamp() {
     auto now = std::chrono::system_clock::now();
     std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm tm = *std::localtime(&tt);
+    std::tm tm{};
+    localtime_r(&tt, &tm);
     char buf[64];
     std::strftime(buf, sizeof(buf), "%FT%T", &tm);
     return std::string(buf);
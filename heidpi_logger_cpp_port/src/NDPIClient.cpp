@@ -1,12 +1,12 @@
 #include "NDPIClient.hpp"
+#include "Logger.hpp"
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
-#include <sstream>
-#include <iomanip>
 #include <stdexcept>
 
 NDPIClient::NDPIClient() {}
@@ -33,34 +33,21 @@ void NDPIClient::connectUnix(const std::string &path) {
         throw std::runtime_error("connect");
 }
 
-void NDPIClient::loop(const std::function<void(const nlohmann::json &)> &cb, const std::string &filter) {
-    // send optional filter expression before starting the receive loop
-    if (!filter.empty()) {
-        std::ostringstream ss;
-        ss << std::setw(6) << std::setfill('0') << filter.size() << filter;
-        std::string msg = ss.str();
-        ssize_t sent = ::send(fd, msg.c_str(), msg.size(), 0);
-        if (sent < 0 || static_cast<size_t>(sent) != msg.size())
-            throw std::runtime_error("send");
-    }
+void NDPIClient::stop() {
+    if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+}
 
+void NDPIClient::loop(const std::function<void(std::string_view)> &cb) {
+    // one recv per batch; every complete frame in it is dispatched in place
     while (true) {
-        char lenbuf[6];
-        // Der Generator verwendet immer fünf Ziffern für die Länge
-        ssize_t n = ::recv(fd, lenbuf, 5, MSG_WAITALL);
+        auto [ptr, space] = decoder.writable();
+        ssize_t n = ::recv(fd, ptr, space, 0);
+        if (n < 0 && errno == EINTR) continue;
         if (n <= 0) break;
-        lenbuf[5] = '\0';
-        size_t len = std::stoul(lenbuf);
-        // anschließend die JSON‑Nutzlast lesen (inklusive '{')
-        std::string payload(len, '\0');
-        n = ::recv(fd, payload.data(), len, MSG_WAITALL);
-        if (n <= 0) break;
-        try {
-            auto j = nlohmann::json::parse(payload);
-            cb(j);
-        } catch (...) {
-            // JSON‑Fehler ignorieren
+        decoder.commit(static_cast<size_t>(n));
+        if (!decoder.drain(cb)) {
+            Logger::error("Invalid frame received from nDPIsrvd, closing connection");
+            break;
         }
     }
 }
-
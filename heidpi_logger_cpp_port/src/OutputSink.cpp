@@ -0,0 +1,302 @@
+#include "OutputSink.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t kChunkSize = 256 * 1024;
+constexpr std::size_t kMinPending = 4 << 20;
+constexpr std::chrono::milliseconds kDefaultTick{1000};
+
+void raisePeak(std::atomic<std::uint64_t> &peak, std::uint64_t value) {
+    auto cur = peak.load(std::memory_order_relaxed);
+    while (value > cur && !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+}
+}
+
+std::mutex OutputSink::registryMtx;
+std::map<std::string, std::shared_ptr<OutputSink>> OutputSink::registry;
+std::thread OutputSink::writer;
+std::chrono::milliseconds OutputSink::writerTick{kDefaultTick};
+std::atomic<bool> OutputSink::writerActive{false};
+std::mutex OutputSink::wakeMtx;
+std::condition_variable OutputSink::writerCv;
+std::atomic<bool> OutputSink::writerSignalled{false};
+std::atomic<bool> OutputSink::writerSleeping{false};
+std::atomic<bool> OutputSink::stopping{false};
+
+std::shared_ptr<OutputSink> OutputSink::open(const std::string &p, const FlushPolicy &policy) {
+    auto key = std::filesystem::path(p).lexically_normal().string();
+    std::lock_guard<std::mutex> lock(registryMtx);
+    auto it = registry.find(key);
+    if (it != registry.end()) return it->second;
+
+    std::error_code ec;
+    auto parent = std::filesystem::path(key).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    int fd = ::open(key.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::error("Failed to open output file: " + key + " " + std::strerror(errno));
+        return nullptr;
+    }
+    std::shared_ptr<OutputSink> sink(new OutputSink(fd, key, policy));
+    registry.emplace(key, sink);
+
+    // the writer wakes up on its own for interval flushes and periodic syncs
+    auto tick = writerTick;
+    if (policy.mode == FlushPolicy::Mode::Interval) {
+        tick = std::min(tick, std::chrono::milliseconds(std::max(1, policy.interval_ms)));
+    }
+    if (policy.durability == FlushPolicy::Durability::Interval) {
+        tick = std::min(tick, std::chrono::milliseconds(std::max(1, policy.sync_interval_ms)));
+    }
+    writerTick = tick;
+    if (!writer.joinable()) {
+        stopping.store(false);
+        writerActive.store(true);
+        writer = std::thread(&OutputSink::writerLoop);
+    }
+    return sink;
+}
+
+void OutputSink::closeAll() {
+    stopping.store(true);
+    { std::lock_guard<std::mutex> lock(wakeMtx); }
+    writerCv.notify_all();
+    if (writer.joinable()) writer.join();
+    writerActive.store(false);
+
+    std::map<std::string, std::shared_ptr<OutputSink>> sinks;
+    {
+        std::lock_guard<std::mutex> lock(registryMtx);
+        sinks.swap(registry);
+        writerTick = kDefaultTick;
+    }
+    for (auto &entry : sinks) entry.second->flush();
+}
+
+std::string OutputSink::stats() {
+    std::lock_guard<std::mutex> lock(registryMtx);
+    std::ostringstream ss;
+    bool first = true;
+    for (auto &entry : registry) {
+        auto &s = *entry.second;
+        auto n = s.batches.load(std::memory_order_relaxed);
+        auto per = [n](std::uint64_t total) { return n ? total / n : 0; };
+        auto syncCount = s.syncs.load(std::memory_order_relaxed);
+        if (!first) ss << ' ';
+        first = false;
+        ss << std::filesystem::path(s.path).filename().string() << "{batches=" << n
+           << " lines/batch=" << per(s.batchLines.load(std::memory_order_relaxed))
+           << " bytes/batch=" << per(s.batchBytes.load(std::memory_order_relaxed))
+           << " peak_bytes=" << s.peakBatchBytes.exchange(0, std::memory_order_relaxed)
+           << " write_us=" << per(s.writeNs.load(std::memory_order_relaxed)) / 1000
+           << " peak_write_us=" << s.peakWriteNs.exchange(0, std::memory_order_relaxed) / 1000
+           << " syncs=" << syncCount
+           << " sync_us=" << (syncCount ? s.syncNs.load(std::memory_order_relaxed) / syncCount / 1000 : 0)
+           << " stalls=" << s.stalls.load(std::memory_order_relaxed) << '}';
+    }
+    return ss.str();
+}
+
+void OutputSink::writerLoop() {
+    std::vector<std::shared_ptr<OutputSink>> sinks;
+    std::chrono::milliseconds tick;
+    {
+        std::lock_guard<std::mutex> lock(registryMtx);
+        tick = writerTick;
+    }
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMtx);
+            writerSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            writerCv.wait_for(lock, tick, [] {
+                return writerSignalled.load(std::memory_order_relaxed) || stopping.load();
+            });
+            writerSleeping.store(false, std::memory_order_relaxed);
+        }
+        // sinks that signal from here on are drained now or in the next round
+        writerSignalled.store(false);
+        bool last = stopping.load();
+        sinks.clear();
+        {
+            std::lock_guard<std::mutex> lock(registryMtx);
+            for (auto &entry : registry) sinks.push_back(entry.second);
+            tick = writerTick;
+        }
+
+        auto now = Clock::now();
+        for (auto &sink : sinks) sink->drain(last, now);
+        if (last) break;
+    }
+}
+
+OutputSink::OutputSink(int f, const std::string &p, const FlushPolicy &pol)
+    : fd(f), path(p), policy(pol), maxPending(std::max(kMinPending, 2 * pol.bytes)) {
+    current.reserve(kChunkSize);
+    lastSync = Clock::now();
+}
+
+OutputSink::~OutputSink() {
+    flush();
+    ::close(fd);
+}
+
+void OutputSink::write(std::string_view line) {
+    std::size_t need = line.size() + 1;
+    std::unique_lock<std::mutex> lock(mtx);
+    if (pendingBytes > 0 && pendingBytes + need > maxPending) {
+        // the writer is behind: wait instead of growing without bound
+        stalls.fetch_add(1, std::memory_order_relaxed);
+        if (writerActive.load()) {
+            wakeWriterLocked();
+            spaceCv.wait(lock, [&] {
+                return pendingBytes == 0 || pendingBytes + need <= maxPending || !writerActive.load();
+            });
+        }
+        if (pendingBytes > 0 && pendingBytes + need > maxPending) {
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+    if (!current.empty() && current.size() + need > kChunkSize) sealLocked();
+    if (pendingBytes == 0) firstPending = Clock::now();
+    current.append(line);
+    current.push_back('\n');
+    pendingBytes += need;
+    ++pendingLines;
+
+    switch (policy.mode) {
+        case FlushPolicy::Mode::Event:
+            wakeWriterLocked();
+            break;
+        case FlushPolicy::Mode::Bytes:
+            if (pendingBytes >= policy.bytes) wakeWriterLocked();
+            break;
+        case FlushPolicy::Mode::Interval:
+            // checked by the writer on every tick
+            break;
+    }
+}
+
+void OutputSink::flush() {
+    drain(true, Clock::now());
+}
+
+bool OutputSink::dueLocked(Clock::time_point now) const {
+    return pendingBytes > 0 && policy.mode == FlushPolicy::Mode::Interval &&
+           now - firstPending >= std::chrono::milliseconds(policy.interval_ms);
+}
+
+void OutputSink::sealLocked() {
+    sealed.push_back(std::move(current));
+    if (!spare.empty()) {
+        current = std::move(spare.back());
+        spare.pop_back();
+    } else {
+        current = std::string();
+        current.reserve(kChunkSize);
+    }
+}
+
+void OutputSink::wakeWriterLocked() {
+    if (ready) return;
+    ready = true;
+    writerSignalled.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!writerSleeping.load(std::memory_order_relaxed)) return; // busy, sees the signal next round
+    { std::lock_guard<std::mutex> lock(wakeMtx); }
+    writerCv.notify_one();
+}
+
+void OutputSink::drain(bool force, Clock::time_point now) {
+    std::lock_guard<std::mutex> io(ioMtx);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (pendingBytes > 0 && (force || ready || dueLocked(now))) {
+            sealLocked();
+            batch.swap(sealed);
+            batchLineCount = pendingLines;
+            pendingBytes = 0;
+            pendingLines = 0;
+        }
+        ready = false;
+    }
+    spaceCv.notify_all();
+    if (!batch.empty()) writeBatch();
+    syncIfDue(now, force);
+}
+
+void OutputSink::writeBatch() {
+    iov.clear();
+    std::size_t total = 0;
+    for (auto &chunk : batch) {
+        if (chunk.empty()) continue;
+        iov.push_back({chunk.data(), chunk.size()});
+        total += chunk.size();
+    }
+
+    auto start = Clock::now();
+    std::size_t idx = 0;
+    while (idx < iov.size()) {
+        int count = static_cast<int>(std::min<std::size_t>(iov.size() - idx, IOV_MAX));
+        ssize_t n = ::writev(fd, &iov[idx], count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            Logger::error("Failed to write output file: " + path + " " + std::strerror(errno));
+            break;
+        }
+        auto left = static_cast<std::size_t>(n);
+        while (idx < iov.size() && left >= iov[idx].iov_len) {
+            left -= iov[idx].iov_len;
+            ++idx;
+        }
+        if (left > 0) {
+            iov[idx].iov_base = static_cast<char *>(iov[idx].iov_base) + left;
+            iov[idx].iov_len -= left;
+        }
+    }
+    auto ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    dirty = true;
+
+    batches.fetch_add(1, std::memory_order_relaxed);
+    batchLines.fetch_add(batchLineCount, std::memory_order_relaxed);
+    batchBytes.fetch_add(total, std::memory_order_relaxed);
+    raisePeak(peakBatchBytes, total);
+    writeNs.fetch_add(ns, std::memory_order_relaxed);
+    raisePeak(peakWriteNs, ns);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &chunk : batch) {
+        chunk.clear();
+        spare.push_back(std::move(chunk));
+    }
+    batch.clear();
+}
+
+void OutputSink::syncIfDue(Clock::time_point now, bool force) {
+    if (!dirty || policy.durability == FlushPolicy::Durability::None) return;
+    if (policy.durability == FlushPolicy::Durability::Interval && !force &&
+        now - lastSync < std::chrono::milliseconds(policy.sync_interval_ms)) {
+        return;
+    }
+    auto start = Clock::now();
+    if (::fdatasync(fd) != 0) {
+        Logger::error("Failed to sync output file: " + path + " " + std::strerror(errno));
+    }
+    syncs.fetch_add(1, std::memory_order_relaxed);
+    syncNs.fetch_add(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()),
+        std::memory_order_relaxed);
+    dirty = false;
+    lastSync = now;
+}
@@ -0,0 +1,162 @@
+#include "OverloadQueue.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+const char *policyName(QueueConfig::Policy policy) {
+    switch (policy) {
+        case QueueConfig::Policy::Block: return "block";
+        case QueueConfig::Policy::DropOldest: return "drop_oldest";
+        case QueueConfig::Policy::DropPriority: return "drop_priority";
+        case QueueConfig::Policy::Sample: return "sample";
+    }
+    return "";
+}
+}
+
+OverloadQueue::OverloadQueue(const QueueConfig &cfg) : config(cfg) {
+    config.capacity_events = std::max<std::size_t>(config.capacity_events, 1);
+    std::size_t cap = 2;
+    while (cap < config.capacity_events) cap <<= 1;
+    mask = cap - 1;
+    slots = std::make_unique<Slot[]>(cap);
+    for (std::size_t i = 0; i < cap; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+std::size_t OverloadQueue::claim(std::size_t &start, std::size_t max) {
+    std::size_t h = head.load(std::memory_order_relaxed);
+    while (true) {
+        std::size_t n = 0;
+        while (n < max && ready(h + n)) ++n;
+        if (n == 0) return 0;
+        if (head.compare_exchange_weak(h, h + n, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            start = h;
+            return n;
+        }
+    }
+}
+
+QueuedEvent OverloadQueue::take(std::size_t index) {
+    Slot &slot = slots[index & mask];
+    QueuedEvent ev = std::move(slot.item);
+    bytes.fetch_sub(ev.bytes, std::memory_order_relaxed);
+    slot.seq.store(index + mask + 1, std::memory_order_release);
+    return ev;
+}
+
+bool OverloadQueue::full(std::size_t incomingBytes) const {
+    std::size_t d = depth();
+    if (d >= config.capacity_events) return true;
+    // a single oversized event is still admitted into an empty queue
+    return d > 0 && bytes.load(std::memory_order_relaxed) + incomingBytes > config.capacity_bytes;
+}
+
+double OverloadQueue::usage() const {
+    double byEvents = static_cast<double>(depth()) / static_cast<double>(config.capacity_events);
+    double byBytes = static_cast<double>(bytes.load(std::memory_order_relaxed)) /
+                     static_cast<double>(std::max<std::size_t>(config.capacity_bytes, 1));
+    return std::max(byEvents, byBytes);
+}
+
+bool OverloadQueue::dropOldest() {
+    std::size_t start = 0;
+    if (claim(start, 1) == 0) return false;
+    QueuedEvent ev = take(start);
+    drop(ev.type);
+    producer.wake();
+    return true;
+}
+
+void OverloadQueue::waitForRoom(std::size_t incomingBytes) {
+    if (!full(incomingBytes)) return;
+    blocked.fetch_add(1, std::memory_order_relaxed);
+    producer.wait([&] { return closed.load(std::memory_order_acquire) || !full(incomingBytes); });
+}
+
+void OverloadQueue::drop(EventType type) {
+    dropped[static_cast<std::size_t>(type)].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool OverloadQueue::push(QueuedEvent &&ev) {
+    switch (config.policy) {
+        case QueueConfig::Policy::Block:
+            waitForRoom(ev.bytes);
+            break;
+        case QueueConfig::Policy::DropOldest:
+            while (full(ev.bytes)) {
+                if (dropOldest()) continue;
+                // the dispatcher claimed the rest and frees it shortly
+                waitForRoom(ev.bytes);
+                break;
+            }
+            break;
+        case QueueConfig::Policy::DropPriority: {
+            double u = usage();
+            if ((ev.type == EventType::Packet || ev.type == EventType::Unknown) && u >= 0.5) {
+                drop(ev.type);
+                return false;
+            }
+            if (ev.type == EventType::Flow && full(ev.bytes)) {
+                drop(ev.type);
+                return false;
+            }
+            waitForRoom(ev.bytes);
+            break;
+        }
+        case QueueConfig::Policy::Sample: {
+            if (full(ev.bytes)) {
+                drop(ev.type);
+                return false;
+            }
+            if (usage() >= 0.5 &&
+                std::uniform_real_distribution<double>(0.0, 1.0)(rng) >= config.sample_rate) {
+                drop(ev.type);
+                return false;
+            }
+            break;
+        }
+    }
+
+    // The slot at tail can still be in use by a consumer that claimed it
+    // but has not finished moving the event out; wait for that.
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    Slot &slot = slots[t & mask];
+    auto slotFree = [&] { return slot.seq.load(std::memory_order_acquire) == t; };
+    while (!slotFree()) {
+        if (closed.load(std::memory_order_acquire)) return false;
+        producer.wait([&] { return closed.load(std::memory_order_acquire) || slotFree(); });
+    }
+    std::size_t evBytes = ev.bytes;
+    slot.item = std::move(ev);
+    bytes.fetch_add(evBytes, std::memory_order_relaxed);
+    slot.seq.store(t + 1, std::memory_order_release);
+    tail.store(t + 1, std::memory_order_release);
+    consumer.wake();
+
+    std::size_t d = depth();
+    std::size_t b = bytes.load(std::memory_order_relaxed);
+    if (d > peakDepth.load(std::memory_order_relaxed)) peakDepth.store(d, std::memory_order_relaxed);
+    if (b > peakBytes.load(std::memory_order_relaxed)) peakBytes.store(b, std::memory_order_relaxed);
+    return true;
+}
+
+void OverloadQueue::close() {
+    closed.store(true, std::memory_order_release);
+    consumer.wake();
+    producer.wake();
+}
+
+std::string OverloadQueue::stats() {
+    std::ostringstream ss;
+    ss << "depth=" << depth() << '/' << config.capacity_events
+       << " bytes=" << bytes.load(std::memory_order_relaxed) << '/' << config.capacity_bytes
+       << " peak_depth=" << peakDepth.exchange(0, std::memory_order_relaxed)
+       << " peak_bytes=" << peakBytes.exchange(0, std::memory_order_relaxed)
+       << " policy=" << policyName(config.policy) << " dropped{";
+    for (std::size_t i = 0; i <= kEventTypeCount; ++i) {
+        if (i) ss << ' ';
+        ss << eventTypeName(static_cast<EventType>(i)) << '=' << dropped[i].load(std::memory_order_relaxed);
+    }
+    ss << "} blocked=" << blocked.load(std::memory_order_relaxed);
+    return ss.str();
+}
@@ -0,0 +1,82 @@
+#include "Projection.hpp"
+#include "JsonWriter.hpp"
+#include <sstream>
+
+struct Projection::Node {
+    bool drop{false};
+    bool keep{false}; // keep-only: this subtree is written
+    std::vector<std::pair<std::string, std::unique_ptr<Node>>> children;
+
+    // plans are a handful of paths per level: a scan beats hashing the key
+    const Node *find(std::string_view key) const {
+        for (const auto &child : children) {
+            if (child.first.size() == key.size() && child.first == key) return child.second.get();
+        }
+        return nullptr;
+    }
+};
+
+// Walks the plan alongside the document.
+class Projection::Writer {
+public:
+    Writer(const Projection &p, std::string &s) : plan(p), json(s) {}
+
+    void object(const EventJson &members, const Node &node, bool kept) {
+        json.raw('{');
+        bool first = true;
+        for (auto it = members.begin(); it != members.end(); ++it) {
+            const Node *child = node.find(it.key());
+            if (child && child->drop) continue;
+            bool whole = kept || !plan.keepOnly || (child && child->keep);
+            bool descend = child && !child->children.empty() && it->is_object();
+            if (!whole && !descend) continue; // not on a kept path
+            if (!first) json.raw(',');
+            first = false;
+            json.key(it.key());
+            if (descend) object(*it, *child, whole);
+            else json.value(*it);
+        }
+        json.raw('}');
+    }
+
+    void value(const EventJson &v) { json.value(v); }
+
+private:
+    const Projection &plan;
+    JsonWriter json;
+};
+
+Projection::Projection(const std::vector<std::string> &keep, const std::vector<std::string> &drop,
+                       const std::vector<std::string> &risks) {
+    if (keep.empty() && drop.empty() && risks.empty()) return;
+    root = std::make_unique<Node>();
+    keepOnly = !keep.empty();
+    for (const auto &p : keep) path(p).keep = true;
+    for (const auto &p : drop) path(p).drop = true;
+    for (const auto &risk : risks) path("ndpi.flow_risk." + risk).drop = true;
+}
+
+Projection::Projection() = default;
+Projection::Projection(Projection &&) noexcept = default;
+Projection &Projection::operator=(Projection &&) noexcept = default;
+Projection::~Projection() = default;
+
+Projection::Node &Projection::path(const std::string &dotted) {
+    Node *node = root.get();
+    std::stringstream ss(dotted);
+    for (std::string segment; std::getline(ss, segment, '.');) {
+        Node *next = const_cast<Node *>(node->find(segment));
+        if (!next) {
+            node->children.emplace_back(segment, std::make_unique<Node>());
+            next = node->children.back().second.get();
+        }
+        node = next;
+    }
+    return *node;
+}
+
+void Projection::serialize(const EventJson &event, std::string &out) const {
+    Writer writer(*this, out);
+    if (!root || !event.is_object()) writer.value(event);
+    else writer.object(event, *root, false);
+}
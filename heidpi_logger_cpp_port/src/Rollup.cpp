@@ -0,0 +1,534 @@
+#include "Rollup.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+
+namespace {
+// group values are joined with US; a missing value is a lone RS
+constexpr char kSeparator = '\x1f';
+constexpr char kMissing = '\x1e';
+// Windows are assigned by processing time, so nothing arrives for a closed
+// window later on; the grace only covers a worker that read the clock just
+// before the window closed and has not counted the event yet.
+constexpr std::chrono::seconds kGrace{1};
+// Count-Min rows and HyperLogLog precision (16 KiB, about 0.8% error)
+constexpr std::size_t kSketchDepth = 4;
+constexpr unsigned kDistinctPrecision = 14;
+const char *const kSides[2] = {"src_ip", "dst_ip"};
+const char *const kMetrics[2] = {"flows", "bytes"};
+
+std::uint64_t number(const EventJson &event, const char *key) {
+    auto it = event.find(key);
+    if (it == event.end()) return 0;
+    if (it->is_number_unsigned()) return it->get<std::uint64_t>();
+    if (it->is_number_integer()) return static_cast<std::uint64_t>(std::max<std::int64_t>(it->get<std::int64_t>(), 0));
+    return 0;
+}
+
+std::string formatTime(std::time_t t, const char *format) {
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char buf[64];
+    std::strftime(buf, sizeof(buf), format, &tm);
+    return std::string(buf);
+}
+
+void csvField(std::ostream &out, const std::string &value) {
+    if (value.find_first_of(",\"\r\n") == std::string::npos) {
+        out << value;
+        return;
+    }
+    out << '"';
+    for (char c : value) {
+        if (c == '"') out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+template <typename F>
+void forEachValue(const std::string &key, F &&fn) {
+    std::size_t start = 0;
+    for (;;) {
+        std::size_t end = key.find(kSeparator, start);
+        if (end == std::string::npos) end = key.size();
+        std::string value = key.substr(start, end - start);
+        fn(value.size() == 1 && value[0] == kMissing ? nullptr : &value);
+        if (end == key.size()) break;
+        start = end + 1;
+    }
+}
+
+template <typename T>
+void bump(std::atomic<T> &counter, T delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+} // namespace
+
+// Open addressing over a fixed number of groups, as in GeoIPCache; key
+// strings keep their buffers from one window to the next.
+class Rollup::Table {
+public:
+    explicit Table(std::size_t capacity) : groups(capacity) {
+        std::size_t size = 1;
+        while (size < 2 * capacity) size <<= 1;
+        index.assign(size, 0);
+        mask = size - 1;
+    }
+
+    // Null if the group is new and the table is full.
+    Counters *find(std::int64_t window, const std::string &key) {
+        std::uint64_t h = hash(window, key);
+        std::size_t pos = h & mask;
+        for (;; pos = (pos + 1) & mask) {
+            std::uint32_t slot = index[pos];
+            if (slot == 0) break;
+            Group &g = groups[slot - 1];
+            if (g.hash == h && g.window == window && g.key == key) return &g.counts;
+        }
+        if (used == groups.size()) return nullptr;
+        Group &g = groups[used];
+        g.window = window;
+        g.hash = h;
+        g.key = key;
+        g.counts = Counters();
+        index[pos] = static_cast<std::uint32_t>(++used);
+        return &g.counts;
+    }
+
+    // Hands out and removes the groups of windows up to `last`.
+    template <typename F>
+    void take(std::int64_t last, F &&fn) {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < used; ++i) {
+            if (groups[i].window <= last) {
+                fn(groups[i].window, groups[i].key, groups[i].counts);
+            } else {
+                if (kept != i) std::swap(groups[kept], groups[i]);
+                ++kept;
+            }
+        }
+        if (kept == used) return;
+        used = kept;
+        std::fill(index.begin(), index.end(), 0);
+        for (std::size_t i = 0; i < used; ++i) {
+            std::size_t pos = groups[i].hash & mask;
+            while (index[pos] != 0) pos = (pos + 1) & mask;
+            index[pos] = static_cast<std::uint32_t>(i + 1);
+        }
+    }
+
+    std::size_t size() const { return used; }
+
+private:
+    struct Group {
+        std::int64_t window{0};
+        std::uint64_t hash{0};
+        std::string key;
+        Counters counts;
+    };
+
+    static std::uint64_t hash(std::int64_t window, const std::string &key) {
+        std::uint64_t h = std::hash<std::string>()(key) ^ static_cast<std::uint64_t>(window) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    std::vector<Group> groups;
+    std::size_t used{0};
+    std::vector<std::uint32_t> index; // slot + 1, 0 = empty
+    std::size_t mask{0};
+};
+
+// Address sketches of one window. counts/top are indexed by
+// metric * 2 + side (metric: flows, bytes; side: src_ip, dst_ip).
+struct Rollup::Sketches {
+    std::int64_t window{0};
+    std::vector<CountMinSketch> counts;
+    std::vector<TopK> top;
+    std::vector<HyperLogLog> distinct; // by side
+    std::vector<std::pair<std::string, std::uint64_t>> candidates[4]; // collector only
+
+    Sketches(std::size_t width, std::size_t k, bool distinctIps) {
+        if (k > 0) {
+            for (int i = 0; i < 4; ++i) {
+                counts.emplace_back(width, kSketchDepth);
+                top.emplace_back(k);
+            }
+        }
+        if (distinctIps) distinct.assign(2, HyperLogLog(kDistinctPrecision));
+    }
+
+    void clear() {
+        for (auto &c : counts) c.clear();
+        for (auto &t : top) t.clear();
+        for (auto &d : distinct) d.clear();
+        for (auto &c : candidates) c.clear();
+    }
+
+    std::size_t memory() const {
+        std::size_t bytes = 0;
+        for (const auto &c : counts) bytes += c.memory();
+        for (const auto &d : distinct) bytes += d.memory();
+        return bytes;
+    }
+};
+
+// Counting state of one worker thread. `mtx` is only contended while the
+// collector takes a closed window.
+struct Rollup::Local {
+    struct Seen {
+        std::int64_t window{std::numeric_limits<std::int64_t>::min()}; // last window that counted the flow
+        std::uint64_t packets{0};
+        std::uint64_t bytes{0};
+    };
+
+    std::mutex mtx;
+    Table table;
+    FlowManager flows;
+    std::vector<Seen> seen; // by FlowManager slot
+    const EventJson *current{nullptr};
+    std::int64_t window{0};
+    Counters delta;
+    std::string key;
+    std::vector<std::unique_ptr<Sketches>> sketches; // open windows
+    std::vector<std::unique_ptr<Sketches>> spare;    // taken by the collector, cleared
+
+    explicit Local(std::size_t maxGroups)
+        : table(maxGroups),
+          flows([this](const FlowManager::Instance &, const FlowManager::Flow &flow,
+                       FlowManager::CleanupReason reason) { release(flow.slot, reason); },
+                1 << 12) {}
+
+    Seen &at(std::uint32_t slot) {
+        if (slot >= seen.size()) seen.resize(slot + 1);
+        return seen[slot];
+    }
+
+    void count(Seen &s, const EventJson &event) {
+        // nDPId's counters are running totals per flow
+        std::uint64_t packets = number(event, "flow_src_packets_processed") + number(event, "flow_dst_packets_processed");
+        std::uint64_t bytes = number(event, "flow_src_tot_l4_payload_len") + number(event, "flow_dst_tot_l4_payload_len");
+        if (packets > s.packets) delta.packets += packets - s.packets;
+        if (bytes > s.bytes) delta.bytes += bytes - s.bytes;
+        s.packets = std::max(s.packets, packets);
+        s.bytes = std::max(s.bytes, bytes);
+        if (s.window != window) {
+            delta.flows = 1;
+            s.window = window;
+        }
+    }
+
+    void release(std::uint32_t slot, FlowManager::CleanupReason reason) {
+        using Reason = FlowManager::CleanupReason;
+        // end/idle arrive with the flow's last event, which still counts
+        if (current && (reason == Reason::FlowEnd || reason == Reason::FlowIdle)) count(at(slot), *current);
+        at(slot) = Seen();
+    }
+};
+
+Rollup::Rollup(const EventConfig &cfg, const std::string &outDir)
+    : width(std::max(1, cfg.rollup_window_seconds)),
+      maxGroups(std::max<std::size_t>(1, cfg.rollup_max_groups)), csv(cfg.rollup_csv),
+      topK(cfg.rollup_top_k), distinctIps(cfg.rollup_distinct_ips),
+      sketchWidth(std::max<std::size_t>(16, cfg.rollup_sketch_width)) {
+    static std::atomic<std::uint64_t> nextId{1};
+    id = nextId.fetch_add(1);
+    for (const auto &name : cfg.rollup_group_by) {
+        std::vector<std::string> path;
+        std::stringstream ss(name);
+        for (std::string segment; std::getline(ss, segment, '.');) path.push_back(segment);
+        if (path.empty()) continue;
+        if (path[0] == "src_geoip2_city" || path[0] == "dst_geoip2_city") needsGeo = true;
+        names.push_back(name);
+        paths.push_back(std::move(path));
+    }
+    auto file = cfg.rollup_filename.empty() ? cfg.filename + "_rollup" : cfg.rollup_filename;
+    basePath = (std::filesystem::path(outDir) / file).string();
+    std::error_code ec;
+    std::filesystem::create_directories(outDir, ec);
+    collector = std::thread(&Rollup::run, this);
+}
+
+Rollup::~Rollup() {
+    {
+        std::lock_guard<std::mutex> lock(collectorMtx);
+        stopping = true;
+    }
+    collectorCv.notify_all();
+    if (collector.joinable()) collector.join();
+}
+
+Rollup::Local &Rollup::local() {
+    // owner ids instead of pointers, as in GeoIP::localCaches()
+    thread_local std::vector<std::pair<std::uint64_t, Local *>> mine;
+    for (auto &entry : mine) {
+        if (entry.first == id) return *entry.second;
+    }
+    auto created = std::make_unique<Local>(maxGroups);
+    std::lock_guard<std::mutex> lock(localsMtx);
+    locals.push_back(std::move(created));
+    mine.emplace_back(id, locals.back().get());
+    return *locals.back();
+}
+
+std::int64_t Rollup::windowOf(std::chrono::system_clock::time_point t) const {
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+    return static_cast<std::int64_t>(seconds) / width;
+}
+
+void Rollup::buildKey(const EventJson &event, const EventJson *geo, std::string &key) const {
+    key.clear();
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        if (i > 0) key += kSeparator;
+        const auto &path = paths[i];
+        bool fromGeo = geo && (path[0] == "src_geoip2_city" || path[0] == "dst_geoip2_city");
+        const EventJson *cur = fromGeo ? geo : &event;
+        for (const auto &segment : path) {
+            auto it = cur->is_object() ? cur->find(std::string_view(segment)) : cur->end();
+            if (it == cur->end()) {
+                cur = nullptr;
+                break;
+            }
+            cur = &*it;
+        }
+        if (!cur || cur->is_null()) key += kMissing;
+        else if (cur->is_string()) key += cur->get_ref<const EventString &>();
+        else key += cur->dump();
+    }
+}
+
+void Rollup::add(const EventJson &event, const GeoIP *geo) {
+    Local &l = local();
+    bool enriched = needsGeo && geo;
+    EventJson cities; // in the event's arena blocks, like its other values
+    if (enriched) {
+        cities = EventJson::object();
+        geo->enrich(event.value("src_ip", ""), event.value("dst_ip", ""), cities);
+    }
+    buildKey(event, enriched ? &cities : nullptr, l.key);
+    auto window = windowOf(std::chrono::system_clock::now());
+
+    std::lock_guard<std::mutex> lock(l.mtx);
+    l.window = window;
+    l.delta = Counters();
+    l.current = &event;
+    std::uint32_t slot = l.flows.update(event);
+    l.current = nullptr;
+    if (slot != FlowManager::kNoFlow) l.count(l.at(slot), event);
+
+    // the sketches are fixed-size, so they see every event, grouped or not
+    if (topK > 0 || distinctIps) sketch(l, event, window);
+    Counters *counts = l.table.find(window, l.key);
+    if (!counts) {
+        bump(dropped);
+        return;
+    }
+    counts->events += 1;
+    counts->flows += l.delta.flows;
+    counts->packets += l.delta.packets;
+    counts->bytes += l.delta.bytes;
+}
+
+void Rollup::sketch(Local &l, const EventJson &event, std::int64_t window) {
+    Sketches *sk = nullptr;
+    for (auto &open : l.sketches) {
+        if (open->window == window) sk = open.get();
+    }
+    if (!sk) {
+        if (l.spare.empty()) {
+            l.sketches.push_back(std::make_unique<Sketches>(sketchWidth, topK, distinctIps));
+        } else {
+            l.sketches.push_back(std::move(l.spare.back()));
+            l.spare.pop_back();
+        }
+        sk = l.sketches.back().get();
+        sk->window = window;
+    }
+    for (int side = 0; side < 2; ++side) {
+        auto it = event.find(kSides[side]);
+        if (it == event.end() || !it->is_string()) continue;
+        const auto &ip = it->get_ref<const EventString &>();
+        std::uint64_t h = sketchHash(ip);
+        if (distinctIps) sk->distinct[side].add(h);
+        if (topK == 0) continue;
+        // flows are counted once per window, bytes as they grow
+        std::uint64_t amount[2] = {l.delta.flows, l.delta.bytes};
+        for (int metric = 0; metric < 2; ++metric) {
+            if (amount[metric] == 0) continue;
+            auto &counts = sk->counts[metric * 2 + side];
+            counts.add(h, amount[metric]);
+            sk->top[metric * 2 + side].offer(ip, h, counts.estimate(h));
+        }
+    }
+}
+
+void Rollup::run() {
+    std::unique_lock<std::mutex> lock(collectorMtx);
+    while (!stopping) {
+        std::int64_t current = windowOf(std::chrono::system_clock::now());
+        std::chrono::system_clock::time_point due(std::chrono::seconds((current + 1) * width));
+        if (collectorCv.wait_until(lock, due + kGrace, [this] { return stopping; })) break;
+        lock.unlock();
+        collect(windowOf(std::chrono::system_clock::now() - kGrace) - 1);
+        lock.lock();
+    }
+}
+
+void Rollup::finish() {
+    {
+        std::lock_guard<std::mutex> lock(collectorMtx);
+        stopping = true;
+    }
+    collectorCv.notify_all();
+    if (collector.joinable()) collector.join();
+    collect(std::numeric_limits<std::int64_t>::max());
+}
+
+void Rollup::collect(std::int64_t last) {
+    std::lock_guard<std::mutex> writing(writeMtx);
+    std::map<std::int64_t, std::map<std::string, Counters>> windows;
+    std::map<std::int64_t, std::unique_ptr<Sketches>> sketches;
+    {
+        std::lock_guard<std::mutex> lock(localsMtx);
+        for (auto &l : locals) {
+            std::lock_guard<std::mutex> guard(l->mtx);
+            for (auto it = l->sketches.begin(); it != l->sketches.end();) {
+                Sketches &part = **it;
+                if (part.window > last) {
+                    ++it;
+                    continue;
+                }
+                auto &sum = sketches[part.window];
+                if (!sum) sum = std::make_unique<Sketches>(sketchWidth, topK, distinctIps);
+                for (std::size_t i = 0; i < part.counts.size(); ++i) {
+                    sum->counts[i].merge(part.counts[i]);
+                    for (const auto &item : part.top[i].items()) sum->candidates[i].emplace_back(item.key, item.hash);
+                }
+                for (std::size_t i = 0; i < part.distinct.size(); ++i) sum->distinct[i].merge(part.distinct[i]);
+                part.clear();
+                l->spare.push_back(std::move(*it));
+                it = l->sketches.erase(it);
+            }
+            l->table.take(last, [&](std::int64_t window, const std::string &key, const Counters &counts) {
+                Counters &sum = windows[window][key];
+                sum.events += counts.events;
+                sum.flows += counts.flows;
+                sum.packets += counts.packets;
+                sum.bytes += counts.bytes;
+            });
+        }
+    }
+    for (const auto &entry : windows) write(entry.first, entry.second);
+    for (auto &entry : sketches) {
+        Sketches &sum = *entry.second;
+        // a thread's heavy hitters, re-ranked by the summed counts
+        for (std::size_t i = 0; i < sum.top.size(); ++i) {
+            for (const auto &candidate : sum.candidates[i]) {
+                sum.top[i].offer(candidate.first, candidate.second, sum.counts[i].estimate(candidate.second));
+            }
+        }
+        writeSketches(entry.first, sum);
+    }
+}
+
+void Rollup::writeSketches(std::int64_t window, const Sketches &sum) {
+    auto start = static_cast<std::time_t>(window * width);
+    std::string path = basePath + '_' + formatTime(start, "%Y%m%dT%H%M%S") + "_sketch.json";
+    nlohmann::json row;
+    row["window_start"] = formatTime(start, "%FT%T");
+    row["window_seconds"] = width;
+    for (std::size_t side = 0; side < sum.distinct.size(); ++side) {
+        row[std::string("distinct_") + kSides[side]] = sum.distinct[side].estimate();
+    }
+    for (std::size_t i = 0; i < sum.top.size(); ++i) {
+        const char *metric = kMetrics[i / 2];
+        auto &list = row[std::string("top_") + kSides[i % 2] + "_by_" + metric];
+        list = nlohmann::json::array();
+        for (const auto &item : sum.top[i].sorted()) {
+            list.push_back({{"ip", item.key}, {metric, item.count}});
+        }
+    }
+    std::ofstream out(path, std::ios::app);
+    if (!(out << row.dump() << '\n')) Logger::error("Failed to write rollup file: " + path);
+}
+
+void Rollup::write(std::int64_t window, const std::map<std::string, Counters> &groups) {
+    auto start = static_cast<std::time_t>(window * width);
+    std::string path = basePath + '_' + formatTime(start, "%Y%m%dT%H%M%S") + (csv ? ".csv" : ".json");
+    std::error_code ec;
+    // a late thread may add to a window that was already written
+    bool fresh = !std::filesystem::exists(path, ec);
+    std::ofstream out(path, std::ios::app);
+    if (!out) {
+        Logger::error("Failed to open rollup file: " + path);
+        return;
+    }
+    std::string startText = formatTime(start, "%FT%T");
+    if (csv) {
+        if (fresh) {
+            out << "window_start,window_seconds";
+            for (const auto &name : names) {
+                out << ',';
+                csvField(out, name);
+            }
+            out << ",events,flows,packets,bytes\n";
+        }
+        for (const auto &group : groups) {
+            out << startText << ',' << width;
+            if (!names.empty()) {
+                forEachValue(group.first, [&](const std::string *value) {
+                    out << ',';
+                    if (value) csvField(out, *value);
+                });
+            }
+            const Counters &c = group.second;
+            out << ',' << c.events << ',' << c.flows << ',' << c.packets << ',' << c.bytes << '\n';
+        }
+    } else {
+        for (const auto &group : groups) {
+            nlohmann::json row;
+            row["window_start"] = startText;
+            row["window_seconds"] = width;
+            std::size_t i = 0;
+            forEachValue(group.first, [&](const std::string *value) {
+                if (i < names.size()) row[names[i++]] = value ? nlohmann::json(*value) : nlohmann::json();
+            });
+            const Counters &c = group.second;
+            row["events"] = c.events;
+            row["flows"] = c.flows;
+            row["packets"] = c.packets;
+            row["bytes"] = c.bytes;
+            out << row.dump() << '\n';
+        }
+    }
+    if (!out) Logger::error("Failed to write rollup file: " + path);
+    bump(windowsWritten, std::uint64_t{1});
+    bump(rowsWritten, static_cast<std::uint64_t>(groups.size()));
+}
+
+std::string Rollup::stats() const {
+    std::size_t groups = 0, sketchBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(localsMtx);
+        for (const auto &l : locals) {
+            std::lock_guard<std::mutex> guard(l->mtx);
+            groups += l->table.size();
+            for (const auto &sk : l->sketches) sketchBytes += sk->memory();
+            for (const auto &sk : l->spare) sketchBytes += sk->memory();
+        }
+    }
+    std::ostringstream ss;
+    ss << "groups=" << groups << " windows=" << windowsWritten.load(std::memory_order_relaxed)
+       << " rows=" << rowsWritten.load(std::memory_order_relaxed)
+       << " dropped=" << dropped.load(std::memory_order_relaxed);
+    if (topK > 0 || distinctIps) ss << " sketch_kb=" << sketchBytes / 1024;
+    return ss.str();
+}
@@ -0,0 +1,145 @@
+#include "SchemaValidator.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json-schema.hpp>
+#include "Logger.hpp"
+
+namespace {
+constexpr std::size_t kBatch = 64;
+// distinct schema/member counters; later ones are summed up under "other"
+constexpr std::size_t kMaxMembers = 256;
+
+template <typename T>
+void bump(std::atomic<T> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Collects every violation of one event instead of stopping at the first.
+class Violations : public nlohmann::json_schema::basic_error_handler {
+public:
+    struct Entry {
+        std::string member;
+        std::string message;
+    };
+
+    void error(const nlohmann::json::json_pointer &ptr, const nlohmann::json &instance,
+               const std::string &message) override {
+        basic_error_handler::error(ptr, instance, message);
+        std::string member = ptr.to_string();
+        // missing and unexpected members are reported on the object: take
+        // the member named in the message
+        auto open = instance.is_object() ? message.find('\'') : std::string::npos;
+        auto close = open == std::string::npos ? open : message.find('\'', open + 1);
+        if (close != std::string::npos) member += "/" + message.substr(open + 1, close - open - 1);
+        if (member.empty()) member = "/";
+        entries.push_back({std::move(member), message});
+    }
+
+    std::vector<Entry> entries;
+};
+} // namespace
+
+struct SchemaValidator::Schema {
+    // "format": "ipv4"/"ipv6" need a format checker
+    Schema() : validator(nullptr, nlohmann::json_schema::default_string_format_check) {}
+    nlohmann::json_schema::json_validator validator;
+};
+
+SchemaValidator::SchemaValidator(const SchemaValidationConfig &cfg)
+    : config(cfg), ring(std::max<std::size_t>(cfg.queue_size, 2)) {
+    for (std::size_t t = 0; t < kEventTypeCount; ++t) {
+        auto type = static_cast<EventType>(t);
+        auto path = std::filesystem::path(config.schema_dir) / (std::string(eventTypeName(type)) + "_event_schema.json");
+        try {
+            std::ifstream in(path);
+            if (!in) throw std::runtime_error("cannot open file");
+            auto schema = std::make_unique<Schema>();
+            schema->validator.set_root_schema(nlohmann::json::parse(in));
+            schemas[t] = std::move(schema);
+        } catch (const std::exception &ex) {
+            Logger::error("schema validation: " + path.string() + ": " + ex.what() + "; " + eventTypeName(type) +
+                          " events are not checked");
+        }
+    }
+    thread = std::thread(&SchemaValidator::run, this);
+}
+
+SchemaValidator::~SchemaValidator() { stop(); }
+
+void SchemaValidator::offer(EventType type, std::string_view frame) {
+    auto t = static_cast<std::size_t>(type);
+    if (t >= kEventTypeCount || !schemas[t]) return;
+    if (std::uniform_real_distribution<double>(0.0, 1.0)(rng) >= config.sample_rate) return;
+    bump(sampled);
+    if (!ring.tryPush(Sample{type, std::string(frame)})) bump(skipped);
+}
+
+void SchemaValidator::stop() {
+    ring.close();
+    if (thread.joinable()) thread.join();
+}
+
+void SchemaValidator::run() {
+#ifdef SCHED_IDLE
+    // only gets a CPU the logging threads leave idle
+    sched_param param{};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+        Logger::info("schema validation: idle priority not available, running at normal priority");
+    }
+#endif
+    auto handle = [this](Sample &&sample) { validate(sample); };
+    while (ring.waitPopBatch(handle, kBatch) > 0) {}
+}
+
+void SchemaValidator::validate(const Sample &sample) {
+    auto doc = nlohmann::json::parse(sample.frame, nullptr, false);
+    if (doc.is_discarded()) {
+        bump(unparsable);
+        return;
+    }
+    Violations found;
+    try {
+        schemas[static_cast<std::size_t>(sample.type)]->validator.validate(doc, found);
+    } catch (const std::exception &ex) {
+        found.entries.push_back({"/", ex.what()});
+    }
+    bump(validated);
+    if (found.entries.empty()) return;
+    bump(invalid);
+    for (const auto &entry : found.entries) count(sample.type, entry.member, entry.message);
+}
+
+void SchemaValidator::count(EventType type, const std::string &member, const std::string &message) {
+    std::string key = eventTypeName(type) + member;
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(violationsMtx);
+        auto it = violations.find(key);
+        if (it == violations.end()) {
+            if (violations.size() >= kMaxMembers) key = std::string(eventTypeName(type)) + "/other";
+            it = violations.emplace(key, 0).first;
+            first = it->second == 0;
+        }
+        ++it->second;
+    }
+    // the first time only, so a drifting field does not flood the log
+    if (first) Logger::info("schema violation: " + key + ": " + message);
+}
+
+std::string SchemaValidator::stats() const {
+    std::ostringstream ss;
+    ss << "sampled=" << sampled.load(std::memory_order_relaxed)
+       << " skipped=" << skipped.load(std::memory_order_relaxed)
+       << " validated=" << validated.load(std::memory_order_relaxed)
+       << " invalid=" << invalid.load(std::memory_order_relaxed)
+       << " unparsable=" << unparsable.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(violationsMtx);
+    for (const auto &[key, n] : violations) ss << ' ' << key << '=' << n;
+    return ss.str();
+}
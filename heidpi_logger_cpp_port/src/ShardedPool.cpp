@@ -0,0 +1,65 @@
+#include "ShardedPool.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+constexpr std::size_t kBatch = 64;
+}
+
+ShardedPool::ShardedPool(std::size_t n, std::size_t shardCapacity, Handler h, Idle i)
+    : handler(std::move(h)), idle(std::move(i)) {
+    n = std::max<std::size_t>(n, 1);
+    shards.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) shards.push_back(std::make_unique<Shard>(shardCapacity));
+    for (auto &s : shards) {
+        Shard *shard = s.get();
+        shard->thread = std::thread([this, shard] { run(*shard); });
+    }
+}
+
+ShardedPool::~ShardedPool() { stop(); }
+
+void ShardedPool::submit(std::uint64_t key, Event &&event) {
+    Shard &shard = *shards[key % shards.size()];
+    shard.ring.push(std::move(event));
+    std::size_t d = shard.ring.size();
+    if (d > shard.peak.load(std::memory_order_relaxed)) shard.peak.store(d, std::memory_order_relaxed);
+}
+
+void ShardedPool::stop() {
+    for (auto &s : shards) s->ring.close();
+    for (auto &s : shards) {
+        if (s->thread.joinable()) s->thread.join();
+    }
+}
+
+std::size_t ShardedPool::depth(std::size_t shard) const {
+    return shards[shard]->ring.size();
+}
+
+std::string ShardedPool::stats() {
+    std::ostringstream ss;
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        auto &s = *shards[i];
+        std::size_t d = s.ring.size();
+        if (i) ss << ' ';
+        ss << '[' << i << "] depth=" << d
+           << " peak=" << s.peak.exchange(d, std::memory_order_relaxed)
+           << " processed=" << s.processed.load(std::memory_order_relaxed);
+    }
+    return ss.str();
+}
+
+void ShardedPool::run(Shard &shard) {
+    auto handle = [&](Event &&queued) {
+        // taken out of the ring, so its arena blocks are released right after
+        Event event = std::move(queued);
+        handler(event);
+    };
+    auto parking = [&] {
+        if (idle) idle();
+    };
+    while (std::size_t n = shard.ring.waitPopBatch(handle, kBatch, parking)) {
+        shard.processed.fetch_add(n, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,132 @@
+#include "Sketch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+std::uint64_t sketchHash(std::string_view key) {
+    // std::hash is not guaranteed to mix well; finish with splitmix64
+    std::uint64_t h = std::hash<std::string_view>()(key) + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+CountMinSketch::CountMinSketch(std::size_t w, std::size_t d) : width(1), depth(std::max<std::size_t>(1, d)) {
+    while (width < w) width <<= 1;
+    counters.assign(width * depth, 0);
+}
+
+void CountMinSketch::add(std::uint64_t hash, std::uint64_t count) {
+    // row i probes h1 + i*h2 (Kirsch/Mitzenmacher), no extra hashing
+    auto h1 = static_cast<std::uint32_t>(hash);
+    auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+    for (std::size_t row = 0; row < depth; ++row) {
+        counters[row * width + ((h1 + row * h2) & (width - 1))] += count;
+    }
+}
+
+std::uint64_t CountMinSketch::estimate(std::uint64_t hash) const {
+    auto h1 = static_cast<std::uint32_t>(hash);
+    auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+    std::uint64_t best = ~0ULL;
+    for (std::size_t row = 0; row < depth; ++row) {
+        best = std::min(best, counters[row * width + ((h1 + row * h2) & (width - 1))]);
+    }
+    return best;
+}
+
+void CountMinSketch::merge(const CountMinSketch &other) {
+    if (other.counters.size() != counters.size()) return;
+    for (std::size_t i = 0; i < counters.size(); ++i) counters[i] += other.counters[i];
+}
+
+void CountMinSketch::clear() {
+    std::fill(counters.begin(), counters.end(), 0);
+}
+
+HyperLogLog::HyperLogLog(unsigned p) : precision(std::min(18U, std::max(4U, p))), registers(std::size_t{1} << precision, 0) {}
+
+void HyperLogLog::add(std::uint64_t hash) {
+    std::size_t index = hash >> (64 - precision);
+    // rank of the first set bit in the remaining bits; a guard bit caps it
+    std::uint64_t rest = (hash << precision) | (std::uint64_t{1} << (precision - 1));
+    auto rank = static_cast<std::uint8_t>(__builtin_clzll(rest) + 1);
+    if (rank > registers[index]) registers[index] = rank;
+}
+
+std::uint64_t HyperLogLog::estimate() const {
+    const double m = static_cast<double>(registers.size());
+    double sum = 0;
+    std::size_t zeros = 0;
+    for (auto r : registers) {
+        sum += std::ldexp(1.0, -r);
+        if (r == 0) ++zeros;
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) e = m * std::log(m / static_cast<double>(zeros));
+    return static_cast<std::uint64_t>(std::llround(e));
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+    if (other.registers.size() != registers.size()) return;
+    for (std::size_t i = 0; i < registers.size(); ++i) registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+void HyperLogLog::clear() {
+    std::fill(registers.begin(), registers.end(), 0);
+}
+
+TopK::TopK(std::size_t count) : k(count) {
+    heap.reserve(k);
+}
+
+void TopK::offer(std::string_view key, std::uint64_t hash, std::uint64_t count) {
+    if (k == 0) return;
+    for (std::size_t i = 0; i < heap.size(); ++i) {
+        if (heap[i].hash != hash || heap[i].key != key) continue;
+        if (count > heap[i].count) {
+            heap[i].count = count;
+            siftDown(i);
+        }
+        return;
+    }
+    if (heap.size() < k) {
+        heap.push_back({std::string(key), hash, count});
+        siftUp(heap.size() - 1);
+    } else if (count > heap[0].count) {
+        heap[0].key.assign(key.data(), key.size());
+        heap[0].hash = hash;
+        heap[0].count = count;
+        siftDown(0);
+    }
+}
+
+std::vector<TopK::Item> TopK::sorted() const {
+    std::vector<Item> out = heap;
+    std::sort(out.begin(), out.end(), [](const Item &a, const Item &b) {
+        return a.count != b.count ? a.count > b.count : a.key < b.key;
+    });
+    return out;
+}
+
+void TopK::siftUp(std::size_t i) {
+    while (i > 0) {
+        std::size_t parent = (i - 1) / 2;
+        if (heap[parent].count <= heap[i].count) break;
+        std::swap(heap[parent], heap[i]);
+        i = parent;
+    }
+}
+
+void TopK::siftDown(std::size_t i) {
+    for (;;) {
+        std::size_t smallest = i;
+        for (std::size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap.size(); ++child) {
+            if (heap[child].count < heap[smallest].count) smallest = child;
+        }
+        if (smallest == i) return;
+        std::swap(heap[smallest], heap[i]);
+        i = smallest;
+    }
+}
@@ -2,8 +2,19 @@
 #include "Logger.hpp"
 #include "NDPIClient.hpp"
 #include "EventProcessor.hpp"
+#include "EventClassifier.hpp"
+#include "FieldExtractor.hpp"
+#include "FilterExpr.hpp"
+#include "FlowManager.hpp"
+#include "OutputSink.hpp"
+#include "EventType.hpp"
+#include "OverloadQueue.hpp"
+#include "SchemaValidator.hpp"
+#include "ShardedPool.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
@@ -12,10 +23,9 @@
 #include <thread>
 #include <vector>
 
-#include <queue>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
-#include <atomic>
 
 struct CLIOptions {
     std::string host{"127.0.0.1"};
@@ -67,7 +77,11 @@ CLIOptions parse(int argc, char **argv) {
                       << "  --port <port>            Set port\n"
                       << "  --write <path>           Set write path\n"
                       << "  --config <path>          Set config path\n"
-                      << "  --filter <expr>          Filter expression\n"
+                      << "  --filter <expr>          Only log events matching expr, e.g.\n"
+                      << "                           \"ndpi.proto and l4_proto == 'tcp'\" or\n"
+                      << "                           \"'ndpi' in json_dict\" (json_dict is the event).\n"
+                      << "                           Not Python: paths, json_dict['key'], literals,\n"
+                      << "                           comparisons, in, not, and, or only\n"
                       << "  --show-daemon-events     Toggle daemon events\n"
                       << "  --show-packet-events     Toggle packet events\n"
                       << "  --show-error-events      Toggle error events\n"
@@ -79,14 +93,39 @@ CLIOptions parse(int argc, char **argv) {
     return o;
 }
 
+// Dispatcher -> shard ring size (events). Kept small so a backlog builds up
+// in the OverloadQueue, where the configured policy applies.
+static constexpr std::size_t kShardQueueCapacity = 1024;
+static constexpr std::size_t kDispatchBatch = 64;
+
+static NDPIClient *gClient = nullptr;
+
+// SIGINT/SIGTERM end the receive loop so buffered output is flushed on exit.
+static void onSignal(int) {
+    if (gClient) gClient->stop();
+}
+
+// One enabled event type: its processor runs on `threads` flow-sharded workers.
 struct Worker {
-    std::string eventKey;
+    EventType type;
     EventConfig config;
     EventProcessor processor;
-    Worker(const std::string &k, const EventConfig &c, const std::string &dir)
-        : eventKey(k), config(c), processor(c, dir) {}
+    ShardedPool pool;
+    Worker(EventType t, const EventConfig &c, const std::string &dir)
+        : type(t), config(c), processor(c, dir),
+          pool(static_cast<std::size_t>(std::max(1, c.threads)), kShardQueueCapacity,
+               [this](Event &event) { processor.process(event); }, [this] { processor.idle(); }) {}
 };
 
+// Events of one flow must stay on one shard; others have no ordering needs.
+static std::uint64_t shardKey(const EventJson &event) {
+    auto it = event.find("flow_id");
+    if (it != event.end() && it->is_number_unsigned()) return it->get<std::uint64_t>();
+    it = event.find("packet_id");
+    if (it != event.end() && it->is_number_unsigned()) return it->get<std::uint64_t>();
+    return 0;
+}
+
 int main(int argc, char **argv) {
     // Help kurz vorher abfangen (wie im Original)
     for (int i = 1; i < argc; ++i) {
@@ -108,18 +147,62 @@ int main(int argc, char **argv) {
     Config cfg(opts.config_path);
     Logger::init(cfg.logging());
 
-    std::vector<Worker> workers;
-    workers.reserve(4);
-    if (opts.show_flow)   workers.emplace_back("flow_event_name",   cfg.flowEvent(),   opts.write_path);
-    if (opts.show_packet) workers.emplace_back("packet_event_name", cfg.packetEvent(), opts.write_path);
-    if (opts.show_daemon) workers.emplace_back("daemon_event_name", cfg.daemonEvent(), opts.write_path);
-    if (opts.show_error)  workers.emplace_back("error_event_name",  cfg.errorEvent(),  opts.write_path);
+    FilterExpr filter;
+    try {
+        filter = FilterExpr::compile(opts.filter);
+    } catch (const std::exception &ex) {
+        Logger::error(ex.what());
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    if (opts.show_flow)   workers.push_back(std::make_unique<Worker>(EventType::Flow,   cfg.flowEvent(),   opts.write_path));
+    if (opts.show_packet) workers.push_back(std::make_unique<Worker>(EventType::Packet, cfg.packetEvent(), opts.write_path));
+    if (opts.show_daemon) workers.push_back(std::make_unique<Worker>(EventType::Daemon, cfg.daemonEvent(), opts.write_path));
+    if (opts.show_error)  workers.push_back(std::make_unique<Worker>(EventType::Error,  cfg.errorEvent(),  opts.write_path));
 
     if (workers.empty()) {
         Logger::error("No event types enabled. Use --show-*_events flags to enable processing.");
         return 1;
     }
 
+    // Felder, die der Reader vor der Übergabe an die Worker braucht
+    FieldSet fields;
+    fields.add({"flow_id"});
+    fields.add({"packet_id"});
+    for (std::size_t t = 0; t < kEventTypeCount; ++t) {
+        fields.add({eventNameKey(static_cast<EventType>(t))});
+    }
+    for (const auto &path : filter.paths()) fields.add(path);
+    for (auto &w : workers) {
+        if (!w->config.raw_output) continue;
+        // Raw-Ausgabe: Member, die angehängt werden bzw. es schon gibt
+        for (const char *key : {"timestamp", "src_ip", "dst_ip", "src_geoip2_city", "dst_geoip2_city"}) {
+            fields.add({key});
+        }
+        if (cfg.parser() == ParseEngine::Nlohmann) {
+            Logger::info("raw_output: parser nlohmann still parses every event in full, use parser: simdjson");
+        }
+        break;
+    }
+    std::unique_ptr<FlowManager> flows;
+    if (cfg.flowTracking().enabled) {
+        // Cleanups wie heiDPIsrvd melden (Flow-Ende, Leerlauf, Timeout, Daemon-Neustart)
+        auto onCleanup = [](const FlowManager::Instance &instance, const FlowManager::Flow &flow,
+                            FlowManager::CleanupReason reason) {
+            Logger::info("flow cleanup: " + instance.alias + '/' + instance.source +
+                         " thread_id=" + std::to_string(flow.threadId) +
+                         " flow_id=" + std::to_string(flow.flowId) +
+                         " reason=" + FlowManager::reasonName(reason));
+        };
+        flows = std::make_unique<FlowManager>(onCleanup, cfg.flowTracking().expected_flows);
+        for (const char *key : {"alias", "source", "thread_id", "thread_ts_usec", "flow_idle_time",
+                                "flow_src_last_pkt_time", "flow_dst_last_pkt_time"}) {
+            fields.add({key});
+        }
+    }
+    auto extractor = FieldExtractor::create(cfg.parser(), fields);
+
     NDPIClient client;
     try {
         if (!opts.unix_path.empty())
@@ -130,75 +213,119 @@ int main(int argc, char **argv) {
         Logger::error(std::string("Failed to connect: ") + ex.what());
         return 1;
     }
+    gClient = &client;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
 
     // -------------------------
-    // NEU: FIFO-Queue + Dispatcher
+    // Begrenzte Queue + Dispatcher
     // -------------------------
-    std::queue<nlohmann::json> eventQueue;         // FIX: Typ-Parameter
-    std::mutex mtx;
-    std::condition_variable cv;
-    std::atomic<bool> done{false};
+    OverloadQueue eventQueue(cfg.queue());
 
-    // Dispatcher-Thread (arbeitet streng nacheinander ab)
-    std::thread dispatcher([&]{
-        while (true) {
-            nlohmann::json event;
-            {
-                std::unique_lock<std::mutex> lk(mtx);
-                cv.wait(lk, [&]{ return done || !eventQueue.empty(); });
-                if (done && eventQueue.empty()) break;
-                event = std::move(eventQueue.front());
-                eventQueue.pop();
-            }
+    // Vorfilter auf den Rohdaten: deaktivierte Typen/Namen nie parsen
+    EventClassifier classifier;
+    for (auto &w : workers) classifier.enable(w->type, w->config);
+    std::atomic<std::uint64_t> filterDropped{0};
 
-            // Event-Typ ermitteln & Namen lesen
-            std::string key;
-            std::string name;
-            if (event.contains("flow_event_name")) {
-                key = "flow_event_name";
-                name = event["flow_event_name"].get<std::string>();   // FIX: get<T>()
-            } else if (event.contains("packet_event_name")) {
-                key = "packet_event_name";
-                name = event["packet_event_name"].get<std::string>(); // FIX: get<T>()
-            } else if (event.contains("daemon_event_name")) {
-                key = "daemon_event_name";
-                name = event["daemon_event_name"].get<std::string>(); // FIX: get<T>()
-            } else if (event.contains("error_event_name")) {
-                key = "error_event_name";
-                name = event["error_event_name"].get<std::string>();  // FIX: get<T>()
-            } else {
-                Logger::info("Received unknown event: missing event name");
-                continue;
-            }
+    // Stichproben gegen die nDPId-Schemas prüfen (eigener Thread, Leerlauf-Priorität)
+    std::unique_ptr<SchemaValidator> validator;
+    if (cfg.schemaValidation().enabled) validator = std::make_unique<SchemaValidator>(cfg.schemaValidation());
 
-            bool handled = false;
-            for (auto &w : workers) {
-                if (w.eventKey != key) continue;
-                w.processor.process(event);
-                handled = true;
-            }
-            if (!handled) {
-                Logger::info("No handler enabled for event '" + name + "' of type " + key);
-            }
+    auto dispatch = [&](QueuedEvent &&ev) {
+        if (ev.type == EventType::Unknown) {
+            Logger::info("Received unknown event: missing event name");
+            return;
         }
+        if (flows) flows->update(ev.type, ev.event.fields);
+        for (auto &w : workers) {
+            if (w->type != ev.type) continue;
+            w->pool.submit(shardKey(ev.event.fields), std::move(ev.event));
+            return;
+        }
+        const char *key = eventNameKey(ev.type);
+        Logger::info("No handler enabled for event '" + ev.event.fields.value(key, std::string()) +
+                     "' of type " + key);
+    };
+
+    // Dispatcher-Thread (holt Events stapelweise ab)
+    std::thread dispatcher([&]{
+        while (eventQueue.waitPopBatch(dispatch, kDispatchBatch) > 0) {}
     });
 
+    // Periodische Statistik (Queue, Drops, Shard-Tiefen, Schreib-Batches)
+    std::mutex statsMtx;
+    std::condition_variable statsCv;
+    bool statsDone = false;
+    std::thread reporter;
+    if (cfg.logging().stats_interval > 0) {
+        reporter = std::thread([&]{
+            std::unique_lock<std::mutex> lk(statsMtx);
+            auto interval = std::chrono::seconds(cfg.logging().stats_interval);
+            while (!statsCv.wait_for(lk, interval, [&]{ return statsDone; })) {
+                Logger::info("queue: " + eventQueue.stats());
+                Logger::info("filtered: " + classifier.stats() +
+                             " expr=" + std::to_string(filterDropped.load(std::memory_order_relaxed)));
+                for (auto &w : workers) {
+                    Logger::info(w->config.filename + " shards: " + w->pool.stats());
+                    auto geo = w->processor.stats();
+                    if (!geo.empty()) Logger::info(w->config.filename + " geoip: " + geo);
+                    auto aggregate = w->processor.aggregateStats();
+                    if (!aggregate.empty()) Logger::info(w->config.filename + " aggregate: " + aggregate);
+                    auto rollup = w->processor.rollupStats();
+                    if (!rollup.empty()) Logger::info(w->config.filename + " rollup: " + rollup);
+                }
+                if (flows) Logger::info("flows: " + flows->stats());
+                if (validator) Logger::info("schema: " + validator->stats());
+                Logger::info("arena: " + EventArena::stats());
+                Logger::info("output: " + OutputSink::stats());
+            }
+        });
+    }
+
     // Reader: liest nonstop und füttert nur die Queue
-    client.loop([&](const nlohmann::json &j) {
-        {
-            std::lock_guard<std::mutex> lk(mtx);
-            eventQueue.push(j);
+    client.loop([&](std::string_view frame) {
+        auto verdict = classifier.classify(frame);
+        if (!verdict.accept) return;
+        QueuedEvent ev;
+        // Rohdaten und Felder landen im Arena-Block des Readers
+        EventArena::Scope scope(ev.event.arena);
+        ev.event.raw.reserve(frame.size() + kParsePadding);
+        ev.event.raw.assign(frame.data(), frame.size());
+        // Nur die benötigten Felder lesen; das volle DOM baut der Worker
+        if (!extractor->extract(ev.event)) return; // JSON‑Fehler ignorieren
+        // Speicher des Events (Rohdaten und geparste Felder), nicht nur der Frame
+        ev.bytes = scope.allocated();
+        ev.type = verdict.type;
+        if (ev.type == EventType::Unknown) {
+            // Rohdaten nicht eindeutig: nach dem Parsen erneut prüfen
+            ev.type = classifyEvent(ev.event.fields);
+            auto name = ev.event.fields.value(eventNameKey(ev.type), std::string());
+            if (!classifier.accepts(ev.type, name)) return;
+        }
+        if (validator) validator->offer(ev.type, frame);
+        if (!filter.matches(ev.event.fields)) {
+            filterDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
         }
-        cv.notify_one();
-    }, opts.filter);
+        eventQueue.push(std::move(ev));
+    });
 
     // Nach Abbruch der Verbindung: Queue leeren lassen und Thread beenden
+    eventQueue.close();
+    dispatcher.join();
+    if (flows) flows->shutdown();
+    if (validator) validator->stop();
+    for (auto &w : workers) {
+        w->pool.stop();
+        w->processor.finish(); // offene Flows und Rollup-Fenster schreiben
+    }
     {
-        std::lock_guard<std::mutex> lk(mtx);
-        done = true;
+        std::lock_guard<std::mutex> lk(statsMtx);
+        statsDone = true;
     }
-    cv.notify_all();
-    dispatcher.join();
+    statsCv.notify_all();
+    if (reporter.joinable()) reporter.join();
+    OutputSink::closeAll();
 
     return 0;
 }
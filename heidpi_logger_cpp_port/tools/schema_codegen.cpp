@@ -0,0 +1,411 @@
+// Build-time generator for the typed event records: turns the nDPId event
+// schemas in heidpi/schema into EventSchema.hpp/.cpp. Per schema one
+// struct with a fixed field per top-level property (numbers as 64-bit
+// integers, strings as views, enum strings as interned enums, objects and
+// arrays as pointers into the document), a presence mask, an overflow list
+// for all other members, and parse/serialize functions. Run by CMake:
+//
+//   schema_codegen <output dir> <*_event_schema.json>...
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// keeps the properties in schema order
+using json = nlohmann::ordered_json;
+
+namespace {
+enum class Kind { Unsigned, Signed, Text, Enum, Object, Array };
+
+struct Property {
+    std::string key;    // as in the document
+    std::string member; // C++ identifier
+    Kind kind;
+    std::string enumType; // Kind::Enum
+};
+
+struct Record {
+    std::string schema; // file name
+    std::string type;   // FlowEventRecord
+    std::vector<Property> properties; // in schema order
+};
+
+struct EnumType {
+    std::string name;
+    std::vector<std::string> values;
+};
+
+// "flow_event_name" -> "FlowEventName", "detection-update" -> "DetectionUpdate"
+std::string camel(const std::string &text) {
+    std::string out;
+    bool upper = true;
+    for (char c : text) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) {
+            upper = true;
+            continue;
+        }
+        out += upper ? static_cast<char>(std::toupper(static_cast<unsigned char>(c))) : c;
+        upper = false;
+    }
+    if (out.empty() || std::isdigit(static_cast<unsigned char>(out[0]))) out.insert(0, "V");
+    return out;
+}
+
+std::string identifier(const std::string &key) {
+    std::string out = key;
+    for (char &c : out) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) c = '_';
+    }
+    return out;
+}
+
+std::string quoted(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + '"';
+}
+
+// String values listed in `schema` (directly or in one of its oneOf branches).
+const json *enumValues(const json &schema) {
+    if (schema.value("type", "") == "string" && schema.contains("enum")) return &schema["enum"];
+    if (schema.contains("oneOf")) {
+        for (const auto &branch : schema["oneOf"]) {
+            if (const json *values = enumValues(branch)) return values;
+        }
+    }
+    return nullptr;
+}
+
+Record load(const std::filesystem::path &path, std::map<std::string, EnumType> &enums) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open " + path.string());
+    json schema = json::parse(in);
+
+    Record record;
+    record.schema = path.filename().string();
+    std::string stem = path.stem().string(); // flow_event_schema
+    auto cut = stem.rfind("_schema");
+    if (cut != std::string::npos) stem.erase(cut);
+    record.type = camel(stem) + "Record";
+
+    for (const auto &[key, property] : schema.at("properties").items()) {
+        Property p{key, identifier(key), Kind::Text, {}};
+        std::string type = property.value("type", "");
+        if (const json *values = enumValues(property)) {
+            p.kind = Kind::Enum;
+            p.enumType = camel(key);
+            EnumType parsed{p.enumType, values->get<std::vector<std::string>>()};
+            auto [it, added] = enums.emplace(key, parsed);
+            if (!added && it->second.values != parsed.values) {
+                throw std::runtime_error(key + ": enum differs between schemas");
+            }
+        } else if (type == "number") {
+            bool unsignedOnly = property.contains("minimum") && property["minimum"].get<double>() >= 0;
+            p.kind = unsignedOnly ? Kind::Unsigned : Kind::Signed;
+        } else if (type == "string") {
+            p.kind = Kind::Text;
+        } else if (type == "object") {
+            p.kind = Kind::Object;
+        } else if (type == "array") {
+            p.kind = Kind::Array;
+        } else {
+            continue; // no fixed type: stays in the overflow
+        }
+        record.properties.push_back(p);
+    }
+    if (record.properties.size() > 64) throw std::runtime_error(record.schema + ": more than 64 fields");
+    return record;
+}
+
+// Wider members first, so numbers sit at fixed offsets without padding.
+int rank(const Property &p) {
+    switch (p.kind) {
+        case Kind::Unsigned:
+        case Kind::Signed: return 0;
+        case Kind::Text: return 1;
+        case Kind::Object:
+        case Kind::Array: return 2;
+        default: return 3;
+    }
+}
+
+void header(std::ostream &out, const std::vector<Record> &records, const std::map<std::string, EnumType> &enums) {
+    out << "// Generated by schema_codegen from heidpi/schema; do not edit.\n"
+           "#pragma once\n"
+           "#include <cstdint>\n"
+           "#include <string_view>\n"
+           "#include <utility>\n"
+           "#include <vector>\n"
+           "#include \"EventArena.hpp\"\n\n"
+           "class JsonWriter;\n\n"
+           "// Members of a document that have no field in its record, or whose value\n"
+           "// does not fit the field, in document order.\n"
+           "using SchemaOverflow = std::vector<std::pair<std::string_view, const EventJson *>,\n"
+           "                                   EventAllocator<std::pair<std::string_view, const EventJson *>>>;\n";
+
+    for (const auto &[key, type] : enums) {
+        out << "\n// " << key << "; Other if missing or not listed in the schema.\n"
+            << "enum class " << type.name << " : std::uint8_t {\n";
+        for (const auto &value : type.values) out << "    " << camel(value) << ",\n";
+        out << "    Other,\n};\n"
+            << "// Schema spelling; \"\" for Other.\n"
+            << "const char *enumName(" << type.name << " value);\n";
+    }
+
+    for (const auto &record : records) {
+        auto fields = record.properties;
+        std::stable_sort(fields.begin(), fields.end(),
+                         [](const Property &a, const Property &b) { return rank(a) < rank(b); });
+        out << "\n/**\n"
+            << " * @brief The top-level members of " << record.schema << " as typed fields.\n"
+            << " *        parse() reads a document in one pass; strings, objects and arrays\n"
+            << " *        stay in the document, which has to outlive the record. serialize()\n"
+            << " *        writes exactly what JsonWriter::value() writes for that document.\n"
+            << " */\n"
+            << "struct " << record.type << " {\n"
+            << "    enum class Field : std::uint8_t {\n";
+        for (const auto &p : record.properties) out << "        " << p.member << ",\n";
+        out << "    };\n\n";
+        for (const auto &p : fields) {
+            if (p.kind == Kind::Enum) {
+                out << "    " << p.enumType << " " << p.member << "{" << p.enumType << "::Other};\n";
+            } else if (p.kind == Kind::Text) {
+                out << "    std::string_view " << p.member << ";\n";
+            } else if (p.kind == Kind::Object || p.kind == Kind::Array) {
+                out << "    const EventJson *" << p.member << "{nullptr};\n";
+            } else {
+                out << "    " << (p.kind == Kind::Unsigned ? "std::uint64_t " : "std::int64_t ") << p.member << "{0};\n";
+            }
+        }
+        out << "    std::uint64_t present{0}; // bit per Field\n"
+            << "    SchemaOverflow overflow;\n\n"
+            << "    bool has(Field field) const { return present >> static_cast<unsigned>(field) & 1; }\n"
+            << "    // False if `document` is not an object. The overflow is only collected\n"
+            << "    // if asked for; serialize() needs it.\n"
+            << "    bool parse(const EventJson &document, bool keepOverflow = true);\n"
+            << "    void serialize(JsonWriter &out) const;\n"
+            << "};\n";
+    }
+}
+
+void source(std::ostream &out, const std::vector<Record> &records, const std::map<std::string, EnumType> &enums) {
+    out << "// Generated by schema_codegen from heidpi/schema; do not edit.\n"
+           "#include \"EventSchema.hpp\"\n"
+           "#include <limits>\n"
+           "#include \"JsonWriter.hpp\"\n\n"
+           "namespace {\n"
+           "using value_t = EventJson::value_t;\n";
+
+    // readers for the kinds of field the schemas use, so none is left unused
+    bool used[6]{};
+    for (const auto &record : records) {
+        for (const auto &p : record.properties) used[static_cast<int>(p.kind)] = true;
+    }
+    if (used[static_cast<int>(Kind::Unsigned)]) {
+        out << "\nbool read(const EventJson &value, std::uint64_t &out) {\n"
+               "    if (value.type() == value_t::number_unsigned) {\n"
+               "        out = value.get<std::uint64_t>();\n"
+               "        return true;\n"
+               "    }\n"
+               "    // the simdjson reader stores small non-negative numbers as signed\n"
+               "    if (value.type() == value_t::number_integer && value.get<std::int64_t>() >= 0) {\n"
+               "        out = static_cast<std::uint64_t>(value.get<std::int64_t>());\n"
+               "        return true;\n"
+               "    }\n"
+               "    return false;\n"
+               "}\n";
+    }
+    if (used[static_cast<int>(Kind::Signed)]) {
+        out << "\nbool read(const EventJson &value, std::int64_t &out) {\n"
+               "    if (value.type() == value_t::number_integer) {\n"
+               "        out = value.get<std::int64_t>();\n"
+               "        return true;\n"
+               "    }\n"
+               "    if (value.type() == value_t::number_unsigned &&\n"
+               "        value.get<std::uint64_t>() <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {\n"
+               "        out = static_cast<std::int64_t>(value.get<std::uint64_t>());\n"
+               "        return true;\n"
+               "    }\n"
+               "    return false;\n"
+               "}\n";
+    }
+    if (used[static_cast<int>(Kind::Text)]) {
+        out << "\nbool read(const EventJson &value, std::string_view &out) {\n"
+               "    if (!value.is_string()) return false;\n"
+               "    out = value.get_ref<const EventString &>();\n"
+               "    return true;\n"
+               "}\n";
+    }
+    if (used[static_cast<int>(Kind::Object)]) {
+        out << "\nbool readObject(const EventJson &value, const EventJson *&out) {\n"
+               "    if (!value.is_object()) return false;\n"
+               "    out = &value;\n"
+               "    return true;\n"
+               "}\n";
+    }
+    if (used[static_cast<int>(Kind::Array)]) {
+        out << "\nbool readArray(const EventJson &value, const EventJson *&out) {\n"
+               "    if (!value.is_array()) return false;\n"
+               "    out = &value;\n"
+               "    return true;\n"
+               "}\n";
+    }
+
+    for (const auto &[key, type] : enums) {
+        out << "\nbool read(const EventJson &value, " << type.name << " &out) {\n"
+            << "    if (!value.is_string()) return false;\n"
+            << "    std::string_view text = value.get_ref<const EventString &>();\n";
+        for (const auto &v : type.values) {
+            out << "    if (text == " << quoted(v) << ") {\n"
+                << "        out = " << type.name << "::" << camel(v) << ";\n"
+                << "        return true;\n"
+                << "    }\n";
+        }
+        out << "    return false;\n}\n";
+    }
+
+    out << "\n// Writes an object member by member in key order: the typed fields come\n"
+           "// in sorted, overflow members that sort before them are merged in.\n"
+           "class Members {\n"
+           "public:\n"
+           "    Members(JsonWriter &writer, const SchemaOverflow &overflow)\n"
+           "        : out(writer), next(overflow.begin()), end(overflow.end()) {\n"
+           "        out.raw('{');\n"
+           "    }\n\n"
+           "    // Starts member `key`; its value is written next.\n"
+           "    JsonWriter &key(std::string_view key) {\n"
+           "        for (; next != end && next->first < key; ++next) member(next->first).value(*next->second);\n"
+           "        return member(key);\n"
+           "    }\n\n"
+           "    void finish() {\n"
+           "        for (; next != end; ++next) member(next->first).value(*next->second);\n"
+           "        out.raw('}');\n"
+           "    }\n\n"
+           "private:\n"
+           "    JsonWriter &member(std::string_view key) {\n"
+           "        if (!first) out.raw(',');\n"
+           "        first = false;\n"
+           "        out.key(key);\n"
+           "        return out;\n"
+           "    }\n\n"
+           "    JsonWriter &out;\n"
+           "    SchemaOverflow::const_iterator next;\n"
+           "    SchemaOverflow::const_iterator end;\n"
+           "    bool first{true};\n"
+           "};\n"
+           "} // namespace\n";
+
+    for (const auto &[key, type] : enums) {
+        out << "\nconst char *enumName(" << type.name << " value) {\n"
+            << "    switch (value) {\n";
+        for (const auto &v : type.values) {
+            out << "        case " << type.name << "::" << camel(v) << ": return " << quoted(v) << ";\n";
+        }
+        out << "        default: return \"\";\n"
+            << "    }\n}\n";
+    }
+
+    for (const auto &record : records) {
+        const std::string &type = record.type;
+        out << "\nbool " << type << "::parse(const EventJson &document, bool keepOverflow) {\n"
+            << "    *this = " << type << "();\n"
+            << "    if (!document.is_object()) return false;\n"
+            << "    for (const auto &member : document.get_ref<const EventJson::object_t &>()) {\n"
+            << "        std::string_view key = member.first;\n"
+            << "        const EventJson &value = member.second;\n"
+            << "        Field field{};\n"
+            << "        bool typed = false;\n"
+            << "        switch (key.size()) {\n";
+        std::map<std::size_t, std::vector<const Property *>> bySize;
+        for (const auto &p : record.properties) bySize[p.key.size()].push_back(&p);
+        for (const auto &[size, group] : bySize) {
+            out << "            case " << size << ":\n";
+            for (std::size_t i = 0; i < group.size(); ++i) {
+                const Property &p = *group[i];
+                const char *reader = p.kind == Kind::Object ? "readObject" : p.kind == Kind::Array ? "readArray" : "read";
+                out << (i == 0 ? "                if" : " else if") << " (key == " << quoted(p.key) << ") {\n"
+                    << "                    typed = " << reader << "(value, " << p.member << ");\n"
+                    << "                    field = Field::" << p.member << ";\n"
+                    << "                }";
+            }
+            out << "\n                break;\n";
+        }
+        out << "            default:\n"
+            << "                break;\n"
+            << "        }\n"
+            << "        if (typed) present |= 1ULL << static_cast<unsigned>(field);\n"
+            << "        else if (keepOverflow) overflow.emplace_back(key, &value);\n"
+            << "    }\n"
+            << "    return true;\n"
+            << "}\n";
+
+        auto sorted = record.properties;
+        std::sort(sorted.begin(), sorted.end(), [](const Property &a, const Property &b) { return a.key < b.key; });
+        out << "\nvoid " << type << "::serialize(JsonWriter &out) const {\n"
+            << "    Members members(out, overflow);\n";
+        for (const auto &p : sorted) {
+            out << "    if (has(Field::" << p.member << ")) members.key(" << quoted(p.key) << ").";
+            switch (p.kind) {
+                case Kind::Unsigned:
+                case Kind::Signed: out << "integer(" << p.member << ");\n"; break;
+                case Kind::Text: out << "string(" << p.member << ");\n"; break;
+                case Kind::Enum: out << "string(enumName(" << p.member << "));\n"; break;
+                default: out << "value(*" << p.member << ");\n"; break;
+            }
+        }
+        out << "    members.finish();\n"
+            << "}\n";
+    }
+}
+
+// Only rewrites files whose content changed, so dependents are not rebuilt.
+void write(const std::filesystem::path &path, const std::string &content) {
+    std::ifstream in(path);
+    std::stringstream old;
+    old << in.rdbuf();
+    if (in && old.str() == content) return;
+    std::ofstream out(path);
+    out << content;
+    if (!out) throw std::runtime_error("cannot write " + path.string());
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: schema_codegen <output dir> <schema.json>...\n";
+        return 2;
+    }
+    try {
+        std::filesystem::path dir = argv[1];
+        std::filesystem::create_directories(dir);
+        std::map<std::string, EnumType> enums;
+        std::vector<Record> records;
+        for (int i = 2; i < argc; ++i) records.push_back(load(argv[i], enums));
+        for (const auto &[key, type] : enums) {
+            for (const auto &value : type.values) {
+                if (camel(value) == "Other") throw std::runtime_error(key + ": value spelled like the Other sentinel");
+            }
+        }
+
+        std::ostringstream hpp, cpp;
+        header(hpp, records, enums);
+        source(cpp, records, enums);
+        write(dir / "EventSchema.hpp", hpp.str());
+        write(dir / "EventSchema.cpp", cpp.str());
+    } catch (const std::exception &ex) {
+        std::cerr << "schema_codegen: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}